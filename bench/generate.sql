@@ -0,0 +1,45 @@
+-- Synthetic tag arrays for benchmarks, see docker/bench.sh.
+--
+-- Variables, all required:
+--   rows        number of rows
+--   vocab       vocabulary size
+--   zipf        Zipf exponent of tag popularity, 0 for uniform
+--   max_items   items per row are uniform in 1..max_items
+--   multibyte   1 for Cyrillic and CJK tags, 0 for ASCII
+--   long_ratio  fraction of items replaced by long (~1 kB) texts
+--   seed        random seed in -1..1
+--
+-- Creates bench_vocab (rank, tag, cumulative probability) and bench_tags.
+
+\set ON_ERROR_STOP 1
+set client_min_messages = warning;
+select setseed(:seed);
+
+drop table if exists bench_vocab;
+create table bench_vocab(rank int primary key, tag text, cum float8);
+insert into bench_vocab(rank, tag, cum)
+	select rank, tag, sum(w) over (order by rank) / sum(w) over ()
+	from (select rank,
+			case when :multibyte = 1 then
+				(select string_agg(chr(case when (rank + k) % 2 = 0
+										then 1072 + (rank * 7 + k * 13) % 32
+										else 19968 + (rank * 31 + k * 17) % 20000 end), '')
+				 from generate_series(1, 3 + rank % 6) k)
+			else 'tag' || rank || substr(md5(rank::text), 1, rank % 8) end as tag,
+			1.0 / power(rank, :zipf) as w
+		  from generate_series(1, :vocab) rank) v;
+create index bench_vocab_cum_idx on bench_vocab(cum);
+analyze bench_vocab;
+
+-- items are drawn by inverse CDF, "0 * j" keeps subqueries correlated
+drop table if exists bench_tags;
+create table bench_tags(id bigserial, val text[]);
+insert into bench_tags(val)
+	select array(
+		select case when random() < :long_ratio
+				then repeat(t || ' ', 1024 / (length(t) + 1)) else t end
+		from (select (select tag from bench_vocab
+					  where cum >= random() + 0 * j order by cum limit 1) t
+			  from generate_series(1, 1 + (random() * (:max_items - 1) + 0 * i)::int) j) s)
+	from generate_series(1, :rows) i;
+vacuum analyze bench_tags;
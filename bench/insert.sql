@@ -0,0 +1,5 @@
+-- pgbench: insert a row of four Zipf-distributed tags
+insert into bench_tags(val)
+	select array(select (select tag from bench_vocab
+						 where cum >= random() + 0 * j order by cum limit 1)
+				 from generate_series(1, 4) j);
@@ -0,0 +1,62 @@
+-- Measurements for docker/bench.sh. Variable opclass names an operator
+-- class to build bench_idx with.
+--
+-- Prints one line: build_ms|index_bytes|recheck_ratio
+-- Recheck ratio is a fraction of heap rows fetched by the index and
+-- rejected by the operator over a fixed set of queries.
+
+\set ON_ERROR_STOP 1
+set client_min_messages = warning;
+
+create or replace function pg_temp.bench_recheck(query text) returns float8[] as $$
+declare
+	line text;
+	fetched float8 := 0;
+	removed float8 := 0;
+begin
+	for line in execute 'explain (analyze, costs off) ' || query loop
+		if line ~ 'Bitmap Heap Scan.*actual' then
+			fetched := fetched + substring(line from 'rows=([0-9.]+)')::float8;
+		elsif line ~ 'Rows Removed by Index Recheck' then
+			removed := removed + substring(line from '([0-9.]+)$')::float8;
+		end if;
+	end loop;
+	return array[fetched, removed];
+end
+$$ language plpgsql;
+
+create or replace function pg_temp.bench_measure(opclass text) returns text as $$
+declare
+	started timestamptz;
+	build_ms float8;
+	fetched float8 := 0;
+	removed float8 := 0;
+	r float8[];
+	q text;
+	t text;
+begin
+	execute 'drop index if exists bench_idx';
+	started := clock_timestamp();
+	execute 'create index bench_idx on bench_tags using gin (val ' || opclass || ')';
+	build_ms := extract(epoch from clock_timestamp() - started) * 1000;
+
+	perform set_config('enable_seqscan', 'off', true);
+	for t in select tag from bench_vocab where rank in (1, 10, 100) loop
+		foreach q in array array[
+			format('select count(*) from bench_tags where val @> array[%L]', t),
+			format('select count(*) from bench_tags where val @@> array[%L]', left(t, 4) || '%'),
+			format('select count(*) from bench_tags where val @@> array[%L]', '%' || substr(t, 2, 3) || '%')]
+		loop
+			r := pg_temp.bench_recheck(q);
+			fetched := fetched + r[1];
+			removed := removed + r[2];
+		end loop;
+	end loop;
+
+	return round(build_ms::numeric, 1) || '|' ||
+		pg_relation_size('bench_idx') || '|' ||
+		coalesce(round((removed / nullif(fetched + removed, 0))::numeric, 4), 0);
+end
+$$ language plpgsql;
+
+select pg_temp.bench_measure(:'opclass');
@@ -0,0 +1,852 @@
+/*
+ * Offline index sizing and selectivity simulator, built without a server
+ * by "make bench-binary":
+ *
+ *   bench/parray_gin_sim [-F text|csv] [-k column] [-n rows] [-t total]
+ *                        [-r rows_per_page] [-w] [-s] [-q queries] dump
+ *
+ * Reads a COPY dump (text or csv format) with a text[] column, extracts
+ * keys of every row with the extension's trigram core and estimates the
+ * size of a parray_gin index over the column. For every query of the
+ * query log it counts candidates the index would return and how many of
+ * them recheck rejects.
+ *
+ * Options:
+ *   -F  dump format, as in COPY (default text)
+ *   -k  1-based number of the text[] column (default 1)
+ *   -n  rows to read, 0 for all (default 0)
+ *   -t  row count of the real table, results are scaled to it
+ *   -r  heap rows per page, used to estimate posting list compression
+ *       (default 50)
+ *   -w  parray_gin_wide_ops keys
+ *   -s  short_keys option
+ *   -q  query log, one query per line: an optional operator (@@> by default
+ *       or @>) followed by an array literal or a single pattern
+ *
+ * Size estimates follow the GIN layout of PostgreSQL 9.4 and later:
+ * varbyte compressed posting lists inline in entry tuples up to a third of
+ * a page, posting trees for longer ones.
+ */
+#include "trgm_shim.h"
+
+#include <ctype.h>
+#include <locale.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "trgm.h"
+
+#define BLCKSZ				8192
+#define PAGE_USABLE			(BLCKSZ - 24 - 16)	/* header and opaque */
+#define GIN_MAX_ITEM_SIZE	((BLCKSZ - 24 - 16) / 3 - 8)
+#define GIN_LEAF_FILL		0.9 /* GIN_DEFAULT_FILLFACTOR */
+#define TUPLE_OVERHEAD		(8 + 4) /* IndexTupleData, line pointer */
+#define MAXALIGN8(len)		(((len) + 7) & ~7)
+
+typedef struct
+{
+	char	  **strs;			/* NULL for null items */
+	int		   *lens;
+	int			count;
+	int			max;
+} Items;
+
+/* Keys of all rows, each row a sorted unique run in one pool */
+typedef struct
+{
+	uint64	   *keys;
+	size_t		nkeys;
+	size_t		maxkeys;
+	size_t	   *rowStart;		/* nrows + 1 offsets */
+	size_t		nrows;
+	size_t		maxrows;
+	Items	   *rowItems;		/* items of every row, for recheck */
+} Rows;
+
+/* Open addressing map of keys to posting counts */
+typedef struct
+{
+	uint64	   *keys;
+	uint64	   *counts;
+	bool	   *used;
+	size_t		size;
+	size_t		count;
+} KeyMap;
+
+static const char *progname = "parray_gin_sim";
+
+static void *
+xmalloc(size_t size)
+{
+	void	   *ptr = malloc(size ? size : 1);
+
+	if (!ptr)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+	return ptr;
+}
+
+static void *
+xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size ? size : 1);
+	if (!ptr)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+	return ptr;
+}
+
+static void
+items_add(Items *items, const char *str, int len)
+{
+	if (items->count >= items->max)
+	{
+		items->max = items->max ? 2 * items->max : 8;
+		items->strs = xrealloc(items->strs, sizeof(char *) * items->max);
+		items->lens = xrealloc(items->lens, sizeof(int) * items->max);
+	}
+	if (str)
+	{
+		items->strs[items->count] = xmalloc(len + 1);
+		memcpy(items->strs[items->count], str, len);
+		items->strs[items->count][len] = '\0';
+	}
+	else
+		items->strs[items->count] = NULL;
+	items->lens[items->count] = len;
+	items->count++;
+}
+
+/*
+ * Parses an array literal like array_in does, nested arrays are
+ * flattened. Returns false on a malformed literal.
+ */
+static bool
+parse_array(const char *str, Items *items)
+{
+	const char *p = str;
+	char	   *buf = xmalloc(strlen(str) + 1);
+	int			depth = 0;
+
+	while (isspace((unsigned char) *p))
+		p++;
+	/* skip dimension decoration like [1:2]={...} */
+	if (*p == '[')
+	{
+		p = strchr(p, '=');
+		if (!p)
+			goto bad;
+		p++;
+	}
+	if (*p != '{')
+		goto bad;
+
+	while (*p)
+	{
+		if (*p == '{')
+		{
+			depth++;
+			p++;
+		}
+		else if (*p == '}')
+		{
+			depth--;
+			p++;
+			if (depth == 0)
+				break;
+		}
+		else if (*p == ',' || isspace((unsigned char) *p))
+			p++;
+		else
+		{
+			int			len = 0;
+			bool		quoted = (*p == '"');
+
+			if (quoted)
+			{
+				p++;
+				while (*p && *p != '"')
+				{
+					if (*p == '\\' && p[1])
+						p++;
+					buf[len++] = *p++;
+				}
+				if (*p != '"')
+					goto bad;
+				p++;
+			}
+			else
+			{
+				while (*p && *p != ',' && *p != '}' && *p != '{')
+				{
+					if (*p == '\\' && p[1])
+						p++;
+					buf[len++] = *p++;
+				}
+				while (len > 0 && isspace((unsigned char) buf[len - 1]))
+					len--;
+			}
+			if (!quoted && len == 4 && strncasecmp(buf, "NULL", 4) == 0)
+				items_add(items, NULL, 0);
+			else
+				items_add(items, buf, len);
+		}
+	}
+	free(buf);
+	return depth == 0;
+
+bad:
+	free(buf);
+	return false;
+}
+
+/*
+ * Extracts a column from a COPY text format line, undoing its escapes.
+ * Returns NULL for a missing column or \N.
+ */
+static char *
+copy_text_field(const char *line, int column)
+{
+	const char *p = line;
+	char	   *res,
+			   *out;
+	int			i;
+
+	for (i = 1; i < column; i++)
+	{
+		p = strchr(p, '\t');
+		if (!p)
+			return NULL;
+		p++;
+	}
+	if (p[0] == '\\' && p[1] == 'N' && (p[2] == '\t' || p[2] == '\0'))
+		return NULL;
+
+	res = out = xmalloc(strlen(p) + 1);
+	while (*p && *p != '\t')
+	{
+		if (*p == '\\' && p[1])
+		{
+			p++;
+			switch (*p)
+			{
+				case 'b':
+					*out++ = '\b';
+					break;
+				case 'f':
+					*out++ = '\f';
+					break;
+				case 'n':
+					*out++ = '\n';
+					break;
+				case 'r':
+					*out++ = '\r';
+					break;
+				case 't':
+					*out++ = '\t';
+					break;
+				case 'v':
+					*out++ = '\v';
+					break;
+				default:
+					*out++ = *p;
+			}
+			p++;
+		}
+		else
+			*out++ = *p++;
+	}
+	*out = '\0';
+	return res;
+}
+
+/*
+ * Extracts a column from a COPY csv format line. Quoted fields spanning
+ * lines are not supported. Returns NULL for a missing column or an
+ * unquoted empty field.
+ */
+static char *
+copy_csv_field(const char *line, int column)
+{
+	const char *p = line;
+	char	   *res,
+			   *out;
+	int			i = 1;
+
+	res = out = xmalloc(strlen(line) + 1);
+	for (;;)
+	{
+		bool		quoted = (*p == '"');
+
+		out = res;
+		if (quoted)
+		{
+			p++;
+			while (*p)
+			{
+				if (*p == '"' && p[1] == '"')
+				{
+					*out++ = '"';
+					p += 2;
+				}
+				else if (*p == '"')
+				{
+					p++;
+					break;
+				}
+				else
+					*out++ = *p++;
+			}
+		}
+		while (*p && *p != ',')
+			*out++ = *p++;
+		*out = '\0';
+
+		if (i == column)
+		{
+			if (!quoted && out == res)
+				break;
+			return res;
+		}
+		if (*p != ',')
+			break;
+		p++;
+		i++;
+	}
+	free(res);
+	return NULL;
+}
+
+/* LIKE of textlike with a backslash escape, case-sensitive */
+static bool
+like_match(const char *str, int slen, const char *pat, int plen)
+{
+	while (plen > 0)
+	{
+		if (*pat == '%')
+		{
+			pat++;
+			plen--;
+			if (plen == 0)
+				return true;
+			while (slen > 0)
+			{
+				int			clen;
+
+				if (like_match(str, slen, pat, plen))
+					return true;
+				clen = pg_mblen(str);
+				str += clen;
+				slen -= clen;
+			}
+			return false;
+		}
+		else if (*pat == '_')
+		{
+			int			clen;
+
+			if (slen <= 0)
+				return false;
+			clen = pg_mblen(str);
+			str += clen;
+			slen -= clen;
+			pat++;
+			plen--;
+		}
+		else
+		{
+			if (*pat == '\\' && plen > 1)
+			{
+				pat++;
+				plen--;
+			}
+			if (slen <= 0 || *pat != *str)
+				return false;
+			pat++;
+			plen--;
+			str++;
+			slen--;
+		}
+	}
+	return slen == 0;
+}
+
+static int
+comp_key(const void *a, const void *b)
+{
+	uint64		ua = *(const uint64 *) a;
+	uint64		ub = *(const uint64 *) b;
+
+	return (ua > ub) ? 1 : ((ua < ub) ? -1 : 0);
+}
+
+/* Sorted unique keys of all items, as GIN stores them for a value */
+static uint64 *
+items_keys(Items *items, bool wide, bool isQuery, bool wildcard,
+		   bool shortKeys, size_t *nkeys)
+{
+	uint64	   *keys = NULL;
+	size_t		count = 0;
+	int			i,
+				j;
+
+	for (i = 0; i < items->count; i++)
+	{
+		uint64	   *itemKeys;
+		int			nitemKeys;
+
+		if (!items->strs[i])
+			continue;
+		itemKeys = generate_item_keys(items->strs[i], items->lens[i], wide,
+									  isQuery, wildcard, shortKeys,
+									  &nitemKeys);
+		keys = xrealloc(keys, sizeof(uint64) * (count + nitemKeys));
+		for (j = 0; j < nitemKeys; j++)
+			keys[count++] = itemKeys[j];
+		pfree(itemKeys);
+	}
+
+	if (count > 1)
+	{
+		size_t		k,
+					last = 0;
+
+		qsort(keys, count, sizeof(uint64), comp_key);
+		for (k = 1; k < count; k++)
+			if (keys[k] != keys[last])
+				keys[++last] = keys[k];
+		count = last + 1;
+	}
+	*nkeys = count;
+	return keys;
+}
+
+static void
+keymap_init(KeyMap *map)
+{
+	map->size = 1024;
+	map->count = 0;
+	map->keys = xmalloc(sizeof(uint64) * map->size);
+	map->counts = xmalloc(sizeof(uint64) * map->size);
+	map->used = calloc(map->size, sizeof(bool));
+}
+
+static size_t
+keymap_slot(KeyMap *map, uint64 key)
+{
+	uint64		h = key * UINT64CONST(0x9E3779B97F4A7C15);
+	size_t		i = (size_t) (h >> 20) & (map->size - 1);
+
+	while (map->used[i] && map->keys[i] != key)
+		i = (i + 1) & (map->size - 1);
+	return i;
+}
+
+static void
+keymap_add(KeyMap *map, uint64 key)
+{
+	size_t		i;
+
+	if (2 * (map->count + 1) > map->size)
+	{
+		KeyMap		old = *map;
+
+		map->size *= 2;
+		map->count = 0;
+		map->keys = xmalloc(sizeof(uint64) * map->size);
+		map->counts = xmalloc(sizeof(uint64) * map->size);
+		map->used = calloc(map->size, sizeof(bool));
+		for (i = 0; i < old.size; i++)
+			if (old.used[i])
+			{
+				size_t		j = keymap_slot(map, old.keys[i]);
+
+				map->used[j] = true;
+				map->keys[j] = old.keys[i];
+				map->counts[j] = old.counts[i];
+				map->count++;
+			}
+		free(old.keys);
+		free(old.counts);
+		free(old.used);
+	}
+
+	i = keymap_slot(map, key);
+	if (!map->used[i])
+	{
+		map->used[i] = true;
+		map->keys[i] = key;
+		map->counts[i] = 0;
+		map->count++;
+	}
+	map->counts[i]++;
+}
+
+static void
+rows_add(Rows *rows, Items *items, uint64 *keys, size_t nkeys)
+{
+	if (rows->nrows + 1 >= rows->maxrows)
+	{
+		rows->maxrows = rows->maxrows ? 2 * rows->maxrows : 1024;
+		rows->rowStart = xrealloc(rows->rowStart,
+								  sizeof(size_t) * (rows->maxrows + 1));
+		rows->rowItems = xrealloc(rows->rowItems,
+								  sizeof(Items) * rows->maxrows);
+	}
+	if (rows->nkeys + nkeys > rows->maxkeys)
+	{
+		rows->maxkeys = Max(2 * rows->maxkeys, rows->nkeys + nkeys);
+		rows->keys = xrealloc(rows->keys, sizeof(uint64) * rows->maxkeys);
+	}
+	rows->rowStart[rows->nrows] = rows->nkeys;
+	memcpy(rows->keys + rows->nkeys, keys, sizeof(uint64) * nkeys);
+	rows->nkeys += nkeys;
+	rows->rowItems[rows->nrows] = *items;
+	rows->nrows++;
+	rows->rowStart[rows->nrows] = rows->nkeys;
+}
+
+/* Bytes of a varbyte encoded item pointer delta */
+static int
+varbyte_len(double delta)
+{
+	int			len = 1;
+
+	while (delta >= 128 && len < 7)
+	{
+		delta /= 128;
+		len++;
+	}
+	return len;
+}
+
+/*
+ * Estimates entry tree and posting tree pages for a key with postings
+ * items. Item pointers are packed as block << 11 | offset, so deltas
+ * depend on the average heap distance between rows with the key.
+ */
+static void
+estimate_key(double postings, double totalRows, double rowsPerPage,
+			 int keySize, double *entryBytes, double *postingPages)
+{
+	double		rowGap = totalRows / postings;
+	double		delta;
+	double		listBytes;
+
+	if (rowGap >= rowsPerPage)
+		delta = rowGap / rowsPerPage * 2048;
+	else
+		delta = rowGap;
+	/* first item is stored uncompressed */
+	listBytes = 6 + (postings - 1) * varbyte_len(delta);
+
+	if (TUPLE_OVERHEAD + keySize + 2 + listBytes <= GIN_MAX_ITEM_SIZE)
+		*entryBytes += MAXALIGN8(TUPLE_OVERHEAD + keySize + 2 + (int) listBytes);
+	else
+	{
+		/* downlink to a posting tree in the entry tuple */
+		*entryBytes += MAXALIGN8(TUPLE_OVERHEAD + keySize + 2 + 4);
+		*postingPages += listBytes / (PAGE_USABLE * GIN_LEAF_FILL) + 1;
+	}
+}
+
+static bool
+row_has_keys(Rows *rows, size_t row, uint64 *keys, size_t nkeys)
+{
+	uint64	   *rk = rows->keys + rows->rowStart[row];
+	size_t		nrk = rows->rowStart[row + 1] - rows->rowStart[row];
+	size_t		i = 0,
+				j = 0;
+
+	while (i < nkeys)
+	{
+		while (j < nrk && rk[j] < keys[i])
+			j++;
+		if (j == nrk || rk[j] != keys[i])
+			return false;
+		i++;
+		j++;
+	}
+	return true;
+}
+
+/* Recheck of @@> (partial) or @>: every pattern matches some item */
+static bool
+row_matches(Items *items, Items *patterns, bool partial)
+{
+	int			i,
+				j;
+
+	for (i = 0; i < patterns->count; i++)
+	{
+		bool		found = false;
+
+		if (!patterns->strs[i])
+			return false;
+		for (j = 0; j < items->count && !found; j++)
+		{
+			if (!items->strs[j])
+				continue;
+			if (partial)
+				found = like_match(items->strs[j], items->lens[j],
+								   patterns->strs[i], patterns->lens[i]);
+			else
+				found = items->lens[j] == patterns->lens[i] &&
+					memcmp(items->strs[j], patterns->strs[i],
+						   items->lens[j]) == 0;
+		}
+		if (!found)
+			return false;
+	}
+	return true;
+}
+
+static void
+run_queries(FILE *f, Rows *rows, bool wide, bool shortKeys, double scale)
+{
+	char	   *line = NULL;
+	size_t		size = 0;
+	ssize_t		len;
+
+	printf("\n%-8s %6s %14s %14s %14s %10s  %s\n", "operator", "keys",
+		   "candidates", "rechecked_out", "matches", "precision", "query");
+	while ((len = getline(&line, &size, f)) >= 0)
+	{
+		Items		patterns = {0};
+		char	   *query = line;
+		bool		partial = true;
+		uint64	   *keys;
+		size_t		nkeys,
+					row;
+		uint64		candidates = 0,
+					matches = 0;
+		int			i;
+
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+		while (isspace((unsigned char) *query))
+			query++;
+		if (*query == '\0' || *query == '#')
+			continue;
+		if (strncmp(query, "@@>", 3) == 0)
+			query += 3;
+		else if (strncmp(query, "@>", 2) == 0)
+		{
+			partial = false;
+			query += 2;
+		}
+		while (isspace((unsigned char) *query))
+			query++;
+
+		if (*query == '{' || *query == '[')
+		{
+			if (!parse_array(query, &patterns))
+			{
+				fprintf(stderr, "%s: malformed query \"%s\"\n", progname, query);
+				continue;
+			}
+		}
+		else
+			items_add(&patterns, query, strlen(query));
+
+		keys = items_keys(&patterns, wide, true, partial, shortKeys, &nkeys);
+		for (row = 0; row < rows->nrows; row++)
+		{
+			if (nkeys > 0 && !row_has_keys(rows, row, keys, nkeys))
+				continue;
+			candidates++;
+			if (row_matches(&rows->rowItems[row], &patterns, partial))
+				matches++;
+		}
+
+		printf("%-8s %6zu %14.0f %14.0f %14.0f %10.4f  %s%s\n",
+			   partial ? "@@>" : "@>", nkeys,
+			   candidates * scale, (candidates - matches) * scale,
+			   matches * scale,
+			   candidates ? (double) matches / candidates : 1.0,
+			   query, nkeys == 0 ? " (full scan)" : "");
+
+		free(keys);
+		for (i = 0; i < patterns.count; i++)
+			free(patterns.strs[i]);
+		free(patterns.strs);
+		free(patterns.lens);
+	}
+	free(line);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-F text|csv] [-k column] [-n rows] [-t total] "
+			"[-r rows_per_page] [-w] [-s] [-q queries] dump\n", progname);
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	bool		csv = false;
+	bool		wide = false;
+	bool		shortKeys = false;
+	int			column = 1;
+	long		limit = 0;
+	double		total = 0;
+	double		rowsPerPage = 50;
+	const char *queryFile = NULL;
+	FILE	   *f;
+	char	   *line = NULL;
+	size_t		size = 0;
+	ssize_t		len;
+	Rows		rows = {0};
+	KeyMap		map;
+	uint64		nitems = 0,
+				nnull = 0,
+				nkeysTotal = 0,
+				nbad = 0;
+	double		scale,
+				entryBytes = 0,
+				postingPages = 0,
+				entryPages;
+	size_t		i;
+	int			opt;
+
+	if (!setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+
+	while ((opt = getopt(argc, argv, "F:k:n:t:r:wsq:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'F':
+				if (strcmp(optarg, "csv") == 0)
+					csv = true;
+				else if (strcmp(optarg, "text") != 0)
+					usage();
+				break;
+			case 'k':
+				column = atoi(optarg);
+				break;
+			case 'n':
+				limit = atol(optarg);
+				break;
+			case 't':
+				total = atof(optarg);
+				break;
+			case 'r':
+				rowsPerPage = atof(optarg);
+				break;
+			case 'w':
+				wide = true;
+				break;
+			case 's':
+				shortKeys = true;
+				break;
+			case 'q':
+				queryFile = optarg;
+				break;
+			default:
+				usage();
+		}
+	}
+	if (optind != argc - 1 || column < 1 || rowsPerPage <= 0)
+		usage();
+
+	f = fopen(argv[optind], "r");
+	if (!f)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+
+	keymap_init(&map);
+	while ((limit <= 0 || (long) rows.nrows < limit) &&
+		   (len = getline(&line, &size, f)) >= 0)
+	{
+		Items		items = {0};
+		char	   *field;
+		uint64	   *keys;
+		size_t		nkeys;
+
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if (!csv && strcmp(line, "\\.") == 0)
+			break;
+
+		field = csv ? copy_csv_field(line, column)
+			: copy_text_field(line, column);
+		if (!field)
+		{
+			/* null array, not indexed */
+			nnull++;
+			continue;
+		}
+		if (!parse_array(field, &items))
+		{
+			nbad++;
+			free(field);
+			continue;
+		}
+		free(field);
+
+		keys = items_keys(&items, wide, false, false, shortKeys, &nkeys);
+		for (i = 0; i < nkeys; i++)
+			keymap_add(&map, keys[i]);
+		rows_add(&rows, &items, keys, nkeys);
+		nitems += items.count;
+		nkeysTotal += nkeys;
+		free(keys);
+	}
+	free(line);
+	fclose(f);
+
+	if (rows.nrows == 0)
+	{
+		fprintf(stderr, "%s: no rows read\n", progname);
+		return 1;
+	}
+	if (nbad > 0)
+		fprintf(stderr, "%s: skipped %llu malformed rows\n",
+				progname, (unsigned long long) nbad);
+
+	scale = total > 0 ? total / rows.nrows : 1.0;
+
+	/*
+	 * Every key found in the sample is assumed to keep its share of rows in
+	 * the full table. Keys missing from the sample are not accounted for.
+	 */
+	for (i = 0; i < map.size; i++)
+		if (map.used[i])
+			estimate_key(map.counts[i] * scale, rows.nrows * scale,
+						 rowsPerPage, wide ? 8 : 4, &entryBytes,
+						 &postingPages);
+	entryPages = entryBytes / PAGE_USABLE * 1.3 + 1;
+
+	printf("rows=%.0f null_rows=%.0f items_per_row=%.2f keys_per_row=%.2f "
+		   "distinct_keys=%zu\n",
+		   rows.nrows * scale, nnull * scale,
+		   (double) nitems / rows.nrows,
+		   (double) nkeysTotal / rows.nrows, map.count);
+	printf("postings=%.0f entry_pages=%.0f posting_pages=%.0f "
+		   "index_bytes=%.0f\n",
+		   nkeysTotal * scale, entryPages, postingPages,
+		   (entryPages + postingPages + 1) * BLCKSZ);
+
+	if (queryFile)
+	{
+		f = fopen(queryFile, "r");
+		if (!f)
+		{
+			perror(queryFile);
+			return 1;
+		}
+		run_queries(f, &rows, wide, shortKeys, scale);
+		fclose(f);
+	}
+
+	return 0;
+}
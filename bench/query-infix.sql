@@ -0,0 +1,3 @@
+-- pgbench: infix pattern of a Zipf-distributed tag
+select count(*) from bench_tags
+	where val @@> array['%' || (select substr(tag, 2, 3) from bench_vocab where cum >= random() order by cum limit 1) || '%'];
@@ -0,0 +1,3 @@
+-- pgbench: prefix pattern of a Zipf-distributed tag
+select count(*) from bench_tags
+	where val @@> array[(select left(tag, 4) from bench_vocab where cum >= random() order by cum limit 1) || '%'];
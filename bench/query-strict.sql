@@ -0,0 +1,3 @@
+-- pgbench: strict lookup of a Zipf-distributed tag
+select count(*) from bench_tags
+	where val @> array[(select tag from bench_vocab where cum >= random() order by cum limit 1)];
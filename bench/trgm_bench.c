@@ -0,0 +1,361 @@
+/*
+ * Standalone benchmark of trigram key generation, built without a server
+ * by "make bench-binary":
+ *
+ *   bench/trgm_bench [-m value|query|similarity|intersect] [-w] [-s]
+ *                    [-r rounds] [-n items] [file]
+ *
+ * Items are read from a file, one per line, or generated like
+ * bench/generate.sql does. Modes:
+ *   value       keys of indexed items (generate_trgm)
+ *   query       keys of like patterns (generate_wildcard_trgm), items are
+ *               wrapped in '%' unless they already have wildcards
+ *   similarity  cnt_sml of every item and the next one
+ *   intersect   intersection kernels on random key sets of balanced and
+ *               unbalanced sizes, items are not used
+ * -w uses wide trigrams, -s adds short keys.
+ *
+ * Prints time and allocations per item and keys per item.
+ */
+#include "trgm_shim.h"
+
+#include <locale.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trgm.h"
+
+typedef enum
+{
+	MODE_VALUE,
+	MODE_QUERY,
+	MODE_SIMILARITY,
+	MODE_INTERSECT
+} BenchMode;
+
+typedef int (*intersect_kernel) (const uint32 *a, int na,
+								 const uint32 *b, int nb);
+
+static const struct
+{
+	const char *name;
+	intersect_kernel kernel;
+}			kernels[] =
+{
+	{"merge", intersect_count_merge},
+	{"gallop", intersect_count_gallop},
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+	{"sse2", intersect_count_sse2},
+#endif
+	{"auto", intersect_count},
+};
+
+/* set sizes: balanced small and large, then unbalanced */
+static const int set_sizes[][2] =
+{
+	{16, 16}, {64, 64}, {1024, 1024}, {8, 1024}, {16, 4096}, {64, 65536}
+};
+
+typedef struct
+{
+	char	  **strs;
+	int		   *lens;
+	int			count;
+	int			max;
+} Items;
+
+static void
+add_item(Items *items, const char *str, int len)
+{
+	if (items->count >= items->max)
+	{
+		items->max = items->max ? 2 * items->max : 1024;
+		items->strs = realloc(items->strs, sizeof(char *) * items->max);
+		items->lens = realloc(items->lens, sizeof(int) * items->max);
+		if (!items->strs || !items->lens)
+		{
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	items->strs[items->count] = strndup(str, len);
+	items->lens[items->count] = len;
+	items->count++;
+}
+
+static void
+read_items(Items *items, FILE *f, int limit)
+{
+	char	   *line = NULL;
+	size_t		size = 0;
+	ssize_t		len;
+
+	while ((limit <= 0 || items->count < limit) &&
+		   (len = getline(&line, &size, f)) >= 0)
+	{
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			len--;
+		add_item(items, line, (int) len);
+	}
+	free(line);
+}
+
+/* Words of 5..14 letters from a skewed alphabet, as in bench/generate.sql */
+static void
+generate_items(Items *items, int count)
+{
+	char		buf[32];
+	unsigned int seed = 42;
+	int			i,
+				j,
+				len;
+
+	for (i = 0; i < count; i++)
+	{
+		seed = seed * 1103515245u + 12345u;
+		len = 5 + (seed >> 16) % 10;
+		for (j = 0; j < len; j++)
+		{
+			seed = seed * 1103515245u + 12345u;
+			buf[j] = 'a' + ((seed >> 16) % 26) * ((seed >> 8) % 26) / 26;
+		}
+		add_item(items, buf, len);
+	}
+}
+
+static int
+has_wildcards(const char *str, int len)
+{
+	return memchr(str, '%', len) != NULL || memchr(str, '_', len) != NULL;
+}
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Sorted unique random even keys */
+static void
+random_keys(uint32 *keys, int n, unsigned int *seed)
+{
+	uint32		key = 0;
+	int			i;
+
+	for (i = 0; i < n; i++)
+	{
+		*seed = *seed * 1103515245u + 12345u;
+		key += 2 + 2 * ((*seed >> 16) % 64);
+		keys[i] = key;
+	}
+}
+
+static void
+bench_intersect(int rounds)
+{
+	size_t		s,
+				k;
+	int			i;
+
+	printf("%-6s %6s %6s %10s %8s\n", "kernel", "na", "nb", "ns/call",
+		   "common");
+	for (s = 0; s < sizeof(set_sizes) / sizeof(set_sizes[0]); s++)
+	{
+		int			na = set_sizes[s][0],
+					nb = set_sizes[s][1];
+		uint32	   *a = malloc(sizeof(uint32) * na);
+		uint32	   *b = malloc(sizeof(uint32) * nb);
+		unsigned int seed = 7;
+		int			calls = Max(1, rounds * 100000 / (na + nb)),
+					expected;
+
+		/* keys of a spread over b, every other one found in b */
+		random_keys(b, nb, &seed);
+		for (i = 0; i < na; i++)
+			a[i] = b[(int) (((int64) i * nb) / na)] + (i % 2);
+		expected = intersect_count_merge(a, na, b, nb);
+
+		for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+		{
+			double		start = now_ns();
+			int			c,
+						res = 0;
+
+			for (c = 0; c < calls; c++)
+				res += kernels[k].kernel(a, na, b, nb);
+			if (res != expected * calls)
+			{
+				fprintf(stderr, "kernel %s: %d common keys instead of %d\n",
+						kernels[k].name, res / calls, expected);
+				exit(1);
+			}
+			printf("%-6s %6d %6d %10.1f %8d\n", kernels[k].name, na, nb,
+				   (now_ns() - start) / calls, expected);
+		}
+		free(a);
+		free(b);
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: trgm_bench [-m value|query|similarity|intersect] "
+			"[-w] [-s] [-r rounds] [-n items] [file]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	BenchMode	mode = MODE_VALUE;
+	bool		wide = false;
+	bool		shortKeys = false;
+	int			rounds = 10;
+	int			limit = 0;
+	Items		items = {0};
+	uint64		keys = 0;
+	uint64		allocs;
+	double		sum = 0;
+	double		start,
+				elapsed;
+	int			round,
+				i,
+				opt;
+
+	if (!setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+
+	while ((opt = getopt(argc, argv, "m:wsr:n:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'm':
+				if (strcmp(optarg, "value") == 0)
+					mode = MODE_VALUE;
+				else if (strcmp(optarg, "query") == 0)
+					mode = MODE_QUERY;
+				else if (strcmp(optarg, "similarity") == 0)
+					mode = MODE_SIMILARITY;
+				else if (strcmp(optarg, "intersect") == 0)
+					mode = MODE_INTERSECT;
+				else
+					usage();
+				break;
+			case 'w':
+				wide = true;
+				break;
+			case 's':
+				shortKeys = true;
+				break;
+			case 'r':
+				rounds = atoi(optarg);
+				break;
+			case 'n':
+				limit = atoi(optarg);
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if (mode == MODE_INTERSECT)
+	{
+		bench_intersect(rounds);
+		return 0;
+	}
+
+	if (optind < argc)
+	{
+		FILE	   *f = fopen(argv[optind], "r");
+
+		if (!f)
+		{
+			perror(argv[optind]);
+			return 1;
+		}
+		read_items(&items, f, limit);
+		fclose(f);
+	}
+	else
+		generate_items(&items, limit > 0 ? limit : 100000);
+
+	if (items.count == 0 || rounds <= 0)
+		usage();
+
+	if (mode == MODE_QUERY)
+	{
+		/* make every item an infix pattern */
+		for (i = 0; i < items.count; i++)
+		{
+			char	   *pattern;
+
+			if (has_wildcards(items.strs[i], items.lens[i]))
+				continue;
+			pattern = malloc(items.lens[i] + 3);
+			pattern[0] = '%';
+			memcpy(pattern + 1, items.strs[i], items.lens[i]);
+			pattern[items.lens[i] + 1] = '%';
+			pattern[items.lens[i] + 2] = '\0';
+			free(items.strs[i]);
+			items.strs[i] = pattern;
+			items.lens[i] += 2;
+		}
+	}
+
+	allocs = trgm_shim_allocs;
+	start = now_ns();
+	for (round = 0; round < rounds; round++)
+	{
+		if (mode == MODE_SIMILARITY)
+		{
+			TRGM	   *prev = generate_trgm(items.strs[0], items.lens[0]);
+
+			for (i = 1; i < items.count; i++)
+			{
+				TRGM	   *trg = generate_trgm(items.strs[i], items.lens[i]);
+
+				sum += cnt_sml(prev, trg);
+				keys += ARRNELEM(trg);
+				pfree(prev);
+				prev = trg;
+			}
+			pfree(prev);
+		}
+		else
+		{
+			for (i = 0; i < items.count; i++)
+			{
+				int			nkeys;
+				uint64	   *itemKeys;
+
+				itemKeys = generate_item_keys(items.strs[i], items.lens[i],
+											  wide, mode == MODE_QUERY,
+											  mode == MODE_QUERY, shortKeys,
+											  &nkeys);
+				keys += nkeys;
+				pfree(itemKeys);
+			}
+		}
+	}
+	elapsed = now_ns() - start;
+	allocs = trgm_shim_allocs - allocs;
+
+	printf("mode=%s wide=%d short_keys=%d items=%d rounds=%d\n",
+		   mode == MODE_VALUE ? "value" :
+		   mode == MODE_QUERY ? "query" : "similarity",
+		   wide, shortKeys, items.count, rounds);
+	printf("ns_per_item=%.1f allocs_per_item=%.2f keys_per_item=%.2f",
+		   elapsed / ((double) rounds * items.count),
+		   (double) allocs / ((double) rounds * items.count),
+		   (double) keys / ((double) rounds * items.count));
+	if (mode == MODE_SIMILARITY)
+		printf(" mean_similarity=%.4f", sum / ((double) rounds * (items.count - 1)));
+	printf("\n");
+
+	return 0;
+}
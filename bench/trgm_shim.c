@@ -0,0 +1,189 @@
+/*
+ * Standalone implementation of the server facilities declared in
+ * src/trgm_shim.h, for builds with TRGM_STANDALONE. Encoding is UTF8,
+ * character classes and case folding come from the LC_CTYPE locale.
+ */
+#include "trgm_shim.h"
+
+#include <stdio.h>
+#include <wchar.h>
+#include <wctype.h>
+
+uint64		trgm_shim_allocs = 0;
+
+static void *
+check_alloc(void *ptr)
+{
+	if (ptr == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+void *
+palloc(size_t size)
+{
+	trgm_shim_allocs++;
+	return check_alloc(malloc(size ? size : 1));
+}
+
+void *
+repalloc(void *ptr, size_t size)
+{
+	trgm_shim_allocs++;
+	return check_alloc(realloc(ptr, size ? size : 1));
+}
+
+void
+pfree(void *ptr)
+{
+	free(ptr);
+}
+
+char *
+pnstrdup(const char *str, size_t len)
+{
+	char	   *res;
+
+	len = strnlen(str, len);
+	res = palloc(len + 1);
+	memcpy(res, str, len);
+	res[len] = '\0';
+	return res;
+}
+
+int
+pg_mblen(const char *str)
+{
+	unsigned char c = *(const unsigned char *) str;
+
+	if ((c & 0x80) == 0)
+		return 1;
+	else if ((c & 0xe0) == 0xc0)
+		return 2;
+	else if ((c & 0xf0) == 0xe0)
+		return 3;
+	else if ((c & 0xf8) == 0xf0)
+		return 4;
+	return 1;
+}
+
+int
+pg_database_encoding_max_length(void)
+{
+	return 4;
+}
+
+/* Decodes one UTF8 character, like pg_utf2wchar_with_len */
+static pg_wchar
+utf8_char(const char *str, int len)
+{
+	const unsigned char *s = (const unsigned char *) str;
+
+	if (len == 2)
+		return ((s[0] & 0x1f) << 6) | (s[1] & 0x3f);
+	else if (len == 3)
+		return ((s[0] & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+	else if (len == 4)
+		return ((s[0] & 0x07) << 18) | ((s[1] & 0x3f) << 12) |
+			((s[2] & 0x3f) << 6) | (s[3] & 0x3f);
+	return s[0];
+}
+
+int
+pg_mb2wchar_with_len(const char *from, pg_wchar *to, int len)
+{
+	int			cnt = 0;
+
+	while (len > 0 && *from)
+	{
+		int			clen = pg_mblen(from);
+
+		if (clen > len)
+			break;
+		*to++ = utf8_char(from, clen);
+		from += clen;
+		len -= clen;
+		cnt++;
+	}
+	*to = 0;
+	return cnt;
+}
+
+static int
+utf8_encode(pg_wchar c, char *out)
+{
+	unsigned char *s = (unsigned char *) out;
+
+	if (c < 0x80)
+	{
+		s[0] = c;
+		return 1;
+	}
+	else if (c < 0x800)
+	{
+		s[0] = 0xc0 | (c >> 6);
+		s[1] = 0x80 | (c & 0x3f);
+		return 2;
+	}
+	else if (c < 0x10000)
+	{
+		s[0] = 0xe0 | (c >> 12);
+		s[1] = 0x80 | ((c >> 6) & 0x3f);
+		s[2] = 0x80 | (c & 0x3f);
+		return 3;
+	}
+	s[0] = 0xf0 | (c >> 18);
+	s[1] = 0x80 | ((c >> 12) & 0x3f);
+	s[2] = 0x80 | ((c >> 6) & 0x3f);
+	s[3] = 0x80 | (c & 0x3f);
+	return 4;
+}
+
+int
+t_isalpha(const char *ptr)
+{
+	return iswalpha((wint_t) utf8_char(ptr, pg_mblen(ptr)));
+}
+
+int
+t_isdigit(const char *ptr)
+{
+	return iswdigit((wint_t) utf8_char(ptr, pg_mblen(ptr)));
+}
+
+int
+t_isspace(const char *ptr)
+{
+	return iswspace((wint_t) utf8_char(ptr, pg_mblen(ptr)));
+}
+
+int
+t_isalnum(const char *ptr)
+{
+	return iswalnum((wint_t) utf8_char(ptr, pg_mblen(ptr)));
+}
+
+/* Lower-cases a string of len bytes into a new null-terminated string */
+char *
+trgm_lower(const char *str, int len)
+{
+	char	   *res = palloc(4 * len + 1),
+			   *out = res;
+	const char *end = str + len;
+
+	while (str < end && *str)
+	{
+		int			clen = pg_mblen(str);
+
+		if (str + clen > end)
+			break;
+		out += utf8_encode((pg_wchar) towlower((wint_t) utf8_char(str, clen)),
+						   out);
+		str += clen;
+	}
+	*out = '\0';
+	return res;
+}
@@ -0,0 +1,84 @@
+#!/bin/sh
+# Benchmark matrix, run on the host from the project root:
+#   docker/bench-matrix.sh
+#
+# Builds the test image for every PostgreSQL version, runs docker/bench.sh
+# in it with the same workload and prints the results side by side, a
+# column per version. BENCH_* variables are passed to bench.sh.
+#
+# Environment:
+#   BENCH_VERSIONS  major versions (default as in the test workflow);
+#                   a version like 19-snapshot uses the snapshot channel
+#   BENCH_METRICS   columns of bench/results/*.tsv to report
+#                   (default build_ms index_bytes tps p50 p95)
+#
+# Writes bench/results/matrix.json, an array of all results, and
+# bench/results/matrix.txt, the report printed.
+set -eu
+
+VERSIONS=${BENCH_VERSIONS:-"9.1 9.5 9.6 10 11 12 13 14 15 16 17 18"}
+METRICS=${BENCH_METRICS:-"build_ms index_bytes tps p50 p95"}
+RESULTS=bench/results
+
+mkdir -p $RESULTS
+rm -f $RESULTS/*.json $RESULTS/*.tsv $RESULTS/matrix.txt
+
+for version in $VERSIONS ; do
+  case $version in
+    *-snapshot)
+      pgversion=${version%-snapshot}
+      channel=bookworm-pgdg-snapshot ;;
+    *)
+      pgversion=$version
+      channel=bookworm-pgdg ;;
+  esac
+  docker build . --file docker/Dockerfile --tag "pgxtest:$version" \
+    --build-arg "PGVERSION=$pgversion" --build-arg "PGCHANNEL=$channel"
+  docker run --rm -v "$(pwd)":/workspace \
+    -e BENCH_ROWS -e BENCH_CLIENTS -e BENCH_DURATION \
+    -e BENCH_DATASETS -e BENCH_OPCLASSES \
+    "pgxtest:$version" /bench.sh
+done
+
+# Every <server_version_num>.json is an array, join their items
+{
+  echo "["
+  first=1
+  for f in $RESULTS/[0-9]*.json ; do
+    [ $first -eq 1 ] || echo ","
+    first=0
+    sed -e '1d' -e '$d' "$f"
+  done
+  echo "]"
+} > $RESULTS/matrix.json
+
+# A table per metric: a row per dataset and operator class, a column per
+# server version in ascending order
+for metric in $METRICS ; do
+  sort -n -k1,1 $RESULTS/[0-9]*.tsv | awk -F '\t' -v metric="$metric" '
+    BEGIN {
+      split("version dataset opclass build_ms index_bytes recheck_ratio tps p50 p95 p99", names, " ")
+      for (i in names) column[names[i]] = i
+      if (!(metric in column)) { print "unknown metric " metric > "/dev/stderr"; exit 1 }
+    }
+    {
+      if (!($1 in seen)) { seen[$1] = 1; versions[++nversions] = $1 }
+      row = $2 " " $3
+      if (!(row in rowseen)) { rowseen[row] = 1; rows[++nrows] = row }
+      value[row, $1] = $(column[metric])
+    }
+    END {
+      printf "%s\n%-40s", metric, "dataset opclass"
+      for (v = 1; v <= nversions; v++) printf " %12s", versions[v]
+      printf "\n"
+      for (r = 1; r <= nrows; r++) {
+        printf "%-40s", rows[r]
+        for (v = 1; v <= nversions; v++) {
+          x = ((rows[r], versions[v]) in value) ? value[rows[r], versions[v]] : "-"
+          printf " %12s", x
+        }
+        printf "\n"
+      }
+      printf "\n"
+    }'
+done | tee $RESULTS/matrix.txt
@@ -0,0 +1,109 @@
+#!/bin/sh
+# Benchmark runner, run in the test image:
+#   docker build . --file docker/Dockerfile --tag pgxtest:17 --build-arg PGVERSION=17
+#   docker run --rm -v `pwd`:/workspace pgxtest:17 /bench.sh
+#
+# Environment:
+#   BENCH_ROWS      rows per dataset (default 200000)
+#   BENCH_CLIENTS   pgbench clients (default 4)
+#   BENCH_DURATION  seconds of every pgbench run (default 30)
+#   BENCH_DATASETS  datasets to run, see below (default all)
+#   BENCH_OPCLASSES operator classes (default parray_gin_ops parray_gin_wide_ops)
+#
+# Writes bench/results/<server_version_num>.json to the workspace:
+# an array of objects with index build time, index size, recheck ratio,
+# and tps and latency percentiles of a mixed insert/query pgbench load.
+# The same numbers go to bench/results/<server_version_num>.tsv, one line
+# per dataset and operator class, for docker/bench-matrix.sh.
+set -eu
+
+ROWS=${BENCH_ROWS:-200000}
+CLIENTS=${BENCH_CLIENTS:-4}
+DURATION=${BENCH_DURATION:-30}
+OPCLASSES=${BENCH_OPCLASSES:-"parray_gin_ops parray_gin_wide_ops"}
+
+# name:vocab:zipf:max_items:multibyte:long_ratio
+ALL_DATASETS="zipf-ascii:50000:1.1:8:0:0
+uniform-ascii:50000:0:8:0:0
+zipf-multibyte:50000:1.1:8:1:0
+zipf-long:50000:1.1:8:0:0.05
+zipf-wide-arrays:50000:1.1:64:0:0
+small-vocab:500:1.1:8:0:0"
+DATASETS=${BENCH_DATASETS:-$(echo "$ALL_DATASETS" | cut -d: -f1)}
+
+cp -a /workspace/* .
+make
+sudo make install
+
+if command pg_isready ; then
+  timeout 600 bash -c 'until pg_isready; do sleep 10; done'
+else
+  sleep 30
+fi
+
+dropdb --if-exists bench 2>/dev/null || dropdb bench 2>/dev/null || true
+createdb -E UTF8 -T template0 --locale=C bench
+PSQL="psql -X -q -At -d bench"
+$PSQL -c 'create extension parray_gin'
+
+VERSION=$($PSQL -c 'show server_version_num')
+mkdir -p /workspace/bench/results
+OUT=/workspace/bench/results/$VERSION.json
+TSV=/workspace/bench/results/$VERSION.tsv
+
+# percentile of latencies (us) in a sorted file -> ms
+percentile() {
+  awk -v p="$2" '{ v[NR] = $1 } END {
+    if (NR == 0) { print 0; exit }
+    i = int(NR * p); if (i < 1) i = 1; printf "%.3f", v[i] / 1000 }' "$1"
+}
+
+echo "[" > "$OUT"
+: > "$TSV"
+first=1
+for name in $DATASETS ; do
+  spec=$(echo "$ALL_DATASETS" | grep "^$name:")
+  vocab=$(echo "$spec" | cut -d: -f2)
+  zipf=$(echo "$spec" | cut -d: -f3)
+  max_items=$(echo "$spec" | cut -d: -f4)
+  multibyte=$(echo "$spec" | cut -d: -f5)
+  long_ratio=$(echo "$spec" | cut -d: -f6)
+
+  for opclass in $OPCLASSES ; do
+    $PSQL -v rows="$ROWS" -v vocab="$vocab" -v zipf="$zipf" \
+      -v max_items="$max_items" -v multibyte="$multibyte" \
+      -v long_ratio="$long_ratio" -v seed=0.5 -f bench/generate.sql > /dev/null
+    result=$($PSQL -v opclass="$opclass" -f bench/measure.sql)
+    build_ms=$(echo "$result" | cut -d'|' -f1)
+    index_bytes=$(echo "$result" | cut -d'|' -f2)
+    recheck_ratio=$(echo "$result" | cut -d'|' -f3)
+
+    rm -rf pgbench_log.*
+    tps=$(pgbench -n -c "$CLIENTS" -T "$DURATION" -l \
+      -f bench/query-strict.sql -f bench/query-prefix.sql \
+      -f bench/query-infix.sql -f bench/insert.sql bench \
+      | awk '/^tps/ { print $3; exit }')
+    cat pgbench_log.* | awk '{ print $3 }' | sort -n > latencies.txt
+    p50=$(percentile latencies.txt 0.50)
+    p95=$(percentile latencies.txt 0.95)
+    p99=$(percentile latencies.txt 0.99)
+
+    [ $first -eq 1 ] || echo "," >> "$OUT"
+    first=0
+    cat >> "$OUT" <<JSON
+  {"server_version_num": $VERSION, "dataset": "$name", "opclass": "$opclass",
+   "rows": $ROWS, "vocab": $vocab, "zipf": $zipf, "max_items": $max_items,
+   "multibyte": $multibyte, "long_ratio": $long_ratio,
+   "build_ms": $build_ms, "index_bytes": $index_bytes,
+   "recheck_ratio": $recheck_ratio, "clients": $CLIENTS, "tps": ${tps:-0},
+   "latency_ms": {"p50": $p50, "p95": $p95, "p99": $p99}}
+JSON
+    printf '%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n' "$VERSION" "$name" \
+      "$opclass" "$build_ms" "$index_bytes" "$recheck_ratio" "${tps:-0}" \
+      "$p50" "$p95" "$p99" >> "$TSV"
+  done
+done
+echo "]" >> "$OUT"
+
+echo "Results written to bench/results/$VERSION.json"
+cat "$OUT"
@@ -0,0 +1,433 @@
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION parray_gin UPDATE " to load this file. \quit
+
+create or replace function parray_gin_options(internal) returns void
+ as 'MODULE_PATHNAME' language C immutable;
+
+create or replace function parray_gin_wide_compare(internal, internal) returns internal
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+create or replace function parray_gin_wide_extract_value(internal, internal, internal) returns internal
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+create or replace function parray_gin_wide_extract_query(internal, internal, internal, internal, internal, internal, internal) returns internal
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+-- operator class with lossless int8 keys for multibyte trigrams
+
+create operator class parray_gin_wide_ops
+for type _text using gin
+as
+	operator	7		@> (_text,_text),   -- strict
+	operator	8		<@ (_text,_text),   -- strict
+	operator	9		@@> (_text,_text),  -- partial
+	operator	10	<@@ (_text,_text),  -- partial
+	function	1	parray_gin_wide_compare(internal, internal),
+	function	2	parray_gin_wide_extract_value(internal, internal, internal),
+	function	3	parray_gin_wide_extract_query(internal, internal, internal, internal, internal, internal, internal),
+	function	4	parray_gin_consistent(internal, internal, internal, internal, internal, internal, internal, internal),
+	storage		int8;
+
+-- operators and operator classes for varchar[] and name[],
+-- items are matched against text[] patterns
+
+create or replace function parray_contains_partial(_varchar, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contains_partial' language C immutable strict;
+comment on function parray_contains_partial(_varchar,_text) is 'varchar array contains compared by partial';
+
+create or replace function parray_contained_partial(_varchar, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contained_partial' language C immutable strict;
+comment on function parray_contained_partial(_varchar,_text) is 'varchar array contained compared by partial';
+
+create or replace function parray_contains_strict(_varchar, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contains_strict' language C immutable strict;
+comment on function parray_contains_strict(_varchar,_text) is 'varchar array contains compared by strict';
+
+create or replace function parray_contained_strict(_varchar, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contained_strict' language C immutable strict;
+comment on function parray_contained_strict(_varchar,_text) is 'varchar array contained compared by strict';
+
+create operator @> (
+  leftarg = _varchar,
+  rightarg = _text,
+  procedure = parray_contains_strict,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator <@ (
+  leftarg = _varchar,
+  rightarg = _text,
+  procedure = parray_contained_strict,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator @@> (
+  leftarg = _varchar,
+  rightarg = _text,
+  procedure = parray_contains_partial,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator <@@ (
+  leftarg = _varchar,
+  rightarg = _text,
+  procedure = parray_contained_partial,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator class parray_gin_varchar_ops
+for type _varchar using gin
+as
+	operator	7		@> (_varchar,_text),   -- strict
+	operator	8		<@ (_varchar,_text),   -- strict
+	operator	9		@@> (_varchar,_text),  -- partial
+	operator	10	<@@ (_varchar,_text),  -- partial
+	function	1	parray_gin_compare(internal, internal),
+	function	2	parray_gin_extract_value(internal, internal, internal),
+	function	3	parray_gin_extract_query(internal, internal, internal, internal, internal, internal, internal),
+	function	4	parray_gin_consistent(internal, internal, internal, internal, internal, internal, internal, internal),
+	storage		int4;
+
+create or replace function parray_contains_partial(_name, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contains_partial' language C immutable strict;
+comment on function parray_contains_partial(_name,_text) is 'name array contains compared by partial';
+
+create or replace function parray_contained_partial(_name, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contained_partial' language C immutable strict;
+comment on function parray_contained_partial(_name,_text) is 'name array contained compared by partial';
+
+create or replace function parray_contains_strict(_name, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contains_strict' language C immutable strict;
+comment on function parray_contains_strict(_name,_text) is 'name array contains compared by strict';
+
+create or replace function parray_contained_strict(_name, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contained_strict' language C immutable strict;
+comment on function parray_contained_strict(_name,_text) is 'name array contained compared by strict';
+
+create operator @> (
+  leftarg = _name,
+  rightarg = _text,
+  procedure = parray_contains_strict,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator <@ (
+  leftarg = _name,
+  rightarg = _text,
+  procedure = parray_contained_strict,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator @@> (
+  leftarg = _name,
+  rightarg = _text,
+  procedure = parray_contains_partial,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator <@@ (
+  leftarg = _name,
+  rightarg = _text,
+  procedure = parray_contained_partial,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator class parray_gin_name_ops
+for type _name using gin
+as
+	operator	7		@> (_name,_text),   -- strict
+	operator	8		<@ (_name,_text),   -- strict
+	operator	9		@@> (_name,_text),  -- partial
+	operator	10	<@@ (_name,_text),  -- partial
+	function	1	parray_gin_compare(internal, internal),
+	function	2	parray_gin_extract_value(internal, internal, internal),
+	function	3	parray_gin_extract_query(internal, internal, internal, internal, internal, internal, internal),
+	function	4	parray_gin_consistent(internal, internal, internal, internal, internal, internal, internal, internal),
+	storage		int4;
+
+-- partial operators and operator class for string items of jsonb arrays,
+-- available since PostgreSQL 9.4
+
+create or replace function parray_gin_jsonb_extract_value(internal, internal, internal) returns internal
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+do $$
+begin
+	if current_setting('server_version_num')::int < 90400 then
+		return;
+	end if;
+	execute 'create or replace function parray_contains_partial(jsonb, _text) returns bool as ''MODULE_PATHNAME'', ''parray_jsonb_contains_partial'' language C immutable strict';
+	execute 'create or replace function parray_contained_partial(jsonb, _text) returns bool as ''MODULE_PATHNAME'', ''parray_jsonb_contained_partial'' language C immutable strict';
+	execute 'create operator @@> (leftarg = jsonb, rightarg = _text, procedure = parray_contains_partial, restrict = contsel, join = contjoinsel)';
+	execute 'create operator <@@ (leftarg = jsonb, rightarg = _text, procedure = parray_contained_partial, restrict = contsel, join = contjoinsel)';
+	execute 'create operator class parray_gin_jsonb_ops for type jsonb using gin as '
+		'operator 9 @@> (jsonb,_text), operator 10 <@@ (jsonb,_text), '
+		'function 1 parray_gin_compare(internal, internal), '
+		'function 2 parray_gin_jsonb_extract_value(internal, internal, internal), '
+		'function 3 parray_gin_extract_query(internal, internal, internal, internal, internal, internal, internal), '
+		'function 4 parray_gin_consistent(internal, internal, internal, internal, internal, internal, internal, internal), '
+		'storage int4';
+	if current_setting('server_version_num')::int >= 130000 then
+		execute 'alter operator family parray_gin_jsonb_ops using gin add function 7 (jsonb) parray_gin_options(internal)';
+	end if;
+end
+$$;
+
+-- trigram collisions of int4 keys
+
+create or replace function parray_gin_collisions(items _text,
+	out trigrams int8, out keys int8, out collision_rate float8)
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_gin_collisions(_text) is 'collision rate of parray_gin_ops keys for given items';
+
+-- element cache statistics of current backend
+
+create or replace function parray_gin_element_cache_stats(
+	out hits int8, out misses int8, out entries int8)
+ as 'MODULE_PATHNAME' language C volatile strict;
+comment on function parray_gin_element_cache_stats() is 'hits, misses and cached items of parray_gin.element_cache_size cache';
+
+-- runtime statistics, shared with shared_preload_libraries
+
+create or replace function parray_gin_stat_counters(
+	out shared bool, out values_extracted int8, out value_keys int8,
+	out queries int8, out query_keys int8, out full_scans int8,
+	out consistent_calls int8, out candidates int8,
+	out recheck_calls int8, out recheck_matches int8,
+	out recheck_memo_hits int8, out recheck_prefilter_skips int8,
+	out stats_reset timestamptz)
+ as 'MODULE_PATHNAME' language C volatile strict;
+comment on function parray_gin_stat_counters() is 'counters of key extraction, consistent and recheck calls';
+
+create or replace function parray_gin_stat_reset() returns timestamptz
+ as 'MODULE_PATHNAME' language C volatile strict;
+comment on function parray_gin_stat_reset() is 'reset parray_gin runtime statistics';
+revoke all on function parray_gin_stat_reset() from public;
+
+create or replace view parray_gin_stats as
+	select shared, values_extracted, value_keys,
+		value_keys::float8 / nullif(values_extracted, 0) as keys_per_value,
+		queries, query_keys,
+		query_keys::float8 / nullif(queries, 0) as keys_per_query,
+		full_scans, consistent_calls, candidates,
+		recheck_calls, recheck_matches,
+		1 - recheck_matches::float8 / nullif(recheck_calls, 0)
+			as recheck_reject_rate,
+		recheck_memo_hits, recheck_prefilter_skips,
+		stats_reset
+	from parray_gin_stat_counters();
+comment on view parray_gin_stats is 'runtime statistics of parray_gin operators and operator classes';
+
+-- keys of items and of an index
+
+create or replace function parray_gin_keys(items _text,
+	patterns bool default false, short_keys bool default false,
+	out item int4, out key int4, out kind text, out trigram text)
+ returns setof record
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_gin_keys(_text, bool, bool) is 'parray_gin_ops keys of items or patterns';
+
+create or replace function parray_gin_index_keys(index regclass,
+	top int4 default 20,
+	out key int4, out kind text, out trigram text, out postings int8,
+	out pages int4)
+ returns setof record
+ as 'MODULE_PATHNAME' language C volatile strict;
+comment on function parray_gin_index_keys(regclass, int4) is 'keys of a parray_gin index with most heap pointers';
+revoke all on function parray_gin_index_keys(regclass, int4) from public;
+
+-- word operator and operator class, a key per lower-cased word of items
+--   arr ~@> array['payment failed'] - some item has both words
+
+create or replace function parray_contains_words(_text, _text) returns bool
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_contains_words(_text,_text) is 'text array has an item with all the words';
+
+create or replace function parray_gin_word_extract_value(internal, internal, internal) returns internal
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+create or replace function parray_gin_word_extract_query(internal, internal, internal, internal, internal, internal, internal) returns internal
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+create operator ~@> (
+  leftarg = _text,
+  rightarg = _text,
+  procedure = parray_contains_words,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator class parray_gin_word_ops
+for type _text using gin
+as
+	operator	11	~@> (_text,_text),
+	function	1	parray_gin_compare(internal, internal),
+	function	2	parray_gin_word_extract_value(internal, internal, internal),
+	function	3	parray_gin_word_extract_query(internal, internal, internal, internal, internal, internal, internal),
+	function	4	parray_gin_consistent(internal, internal, internal, internal, internal, internal, internal, internal),
+	storage		int4;
+
+-- accent-insensitive partial operators, items and patterns are compared
+-- without diacritics; the index finds accented items with option unaccent
+--   arr @@~> array['cafe%'] - partial contains, matches 'Café'
+
+create or replace function parray_contains_partial_ai(_text, _text) returns bool
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_contains_partial_ai(_text,_text) is 'text array contains compared by partial without diacritics';
+
+create or replace function parray_contained_partial_ai(_text, _text) returns bool
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_contained_partial_ai(_text,_text) is 'text array contained compared by partial without diacritics';
+
+create operator @@~> (
+  leftarg = _text,
+  rightarg = _text,
+  procedure = parray_contains_partial_ai,
+  commutator = '<~@@',
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator <~@@ (
+  leftarg = _text,
+  rightarg = _text,
+  procedure = parray_contained_partial_ai,
+  commutator = '@@~>',
+  restrict = contsel,
+  join = contjoinsel
+);
+
+alter operator family parray_gin_ops using gin add
+	operator	12	@@~> (_text,_text),
+	operator	13	<~@@ (_text,_text);
+alter operator family parray_gin_wide_ops using gin add
+	operator	12	@@~> (_text,_text),
+	operator	13	<~@@ (_text,_text);
+
+-- precomputed trigrams of items, e.g. for a generated column
+--   trgm %@@> array['%foo%'] - may contain, prefilter for @@>
+--   trgm <-> 'foo' - distance to the most similar item
+
+create type parray_trgm;
+
+create or replace function parray_trgm_in(cstring) returns parray_trgm
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+create or replace function parray_trgm_out(parray_trgm) returns cstring
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+create or replace function parray_trgm_recv(internal) returns parray_trgm
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+create or replace function parray_trgm_send(parray_trgm) returns bytea
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+create type parray_trgm (
+  internallength = variable,
+  input = parray_trgm_in,
+  output = parray_trgm_out,
+  receive = parray_trgm_recv,
+  send = parray_trgm_send,
+  alignment = int4,
+  storage = extended
+);
+comment on type parray_trgm is 'sorted trigrams of every item of a text array';
+
+create or replace function parray_trgm(_text) returns parray_trgm
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_trgm(_text) is 'trigrams of every item of a text array';
+
+create or replace function parray_trgm_contains_partial(parray_trgm, _text) returns bool
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_trgm_contains_partial(parray_trgm,_text) is 'text array may contain compared by partial';
+
+create or replace function parray_trgm_similarity(parray_trgm, text) returns float4
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_trgm_similarity(parray_trgm,text) is 'greatest trigram similarity of an item and a text';
+
+create or replace function parray_trgm_distance(parray_trgm, text) returns float4
+ as 'MODULE_PATHNAME' language C immutable strict;
+comment on function parray_trgm_distance(parray_trgm,text) is 'one minus parray_trgm_similarity';
+
+create operator %@@> (
+  leftarg = parray_trgm,
+  rightarg = _text,
+  procedure = parray_trgm_contains_partial,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator <-> (
+  leftarg = parray_trgm,
+  rightarg = text,
+  procedure = parray_trgm_distance
+);
+
+-- operator class options, available since PostgreSQL 13
+
+do $$
+begin
+	if current_setting('server_version_num')::int >= 130000 then
+		execute 'alter operator family parray_gin_ops using gin add function 7 (_text) parray_gin_options(internal)';
+		execute 'alter operator family parray_gin_wide_ops using gin add function 7 (_text) parray_gin_options(internal)';
+		execute 'alter operator family parray_gin_varchar_ops using gin add function 7 (_varchar) parray_gin_options(internal)';
+		execute 'alter operator family parray_gin_name_ops using gin add function 7 (_name) parray_gin_options(internal)';
+	end if;
+end
+$$;
+
+-- planner support for operator functions, available since PostgreSQL 12
+
+create or replace function parray_support(internal) returns internal
+ as 'MODULE_PATHNAME' language C immutable strict;
+
+do $$
+declare
+	f regprocedure;
+begin
+	if current_setting('server_version_num')::int < 120000 then
+		return;
+	end if;
+	for f in select p.oid from pg_proc p
+		where p.proname in ('parray_contains_strict', 'parray_contained_strict',
+							'parray_contains_partial', 'parray_contained_partial')
+			and p.pronamespace = current_schema()::regnamespace
+	loop
+		execute 'alter function ' || f::text || ' support parray_support';
+	end loop;
+end
+$$;
+
+-- parallel safety, available since PostgreSQL 9.6
+-- statistics are backend-local, so restricted to the leader
+
+do $$
+declare
+	f regprocedure;
+begin
+	if current_setting('server_version_num')::int < 90600 then
+		return;
+	end if;
+	for f in select p.oid from pg_proc p
+		join pg_depend d on d.classid = 'pg_proc'::regclass and d.objid = p.oid
+			and d.deptype = 'e'
+		join pg_extension e on e.oid = d.refobjid and e.extname = 'parray_gin'
+	loop
+		if f in ('parray_gin_element_cache_stats()'::regprocedure,
+				'parray_gin_stat_counters()'::regprocedure,
+				'parray_gin_stat_reset()'::regprocedure) then
+			execute 'alter function ' || f::text || ' parallel restricted';
+		else
+			execute 'alter function ' || f::text || ' parallel safe';
+		end if;
+	end loop;
+end
+$$;
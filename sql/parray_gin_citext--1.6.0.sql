@@ -0,0 +1,94 @@
+/* parray_gin_citext--1.6.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION parray_gin_citext" to load this file. \quit
+
+-- operators and operator class of parray_gin for citext[],
+-- items are matched case-insensitively
+
+create or replace function parray_contains_partial(_citext, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contains_partial_ci' language C immutable strict;
+comment on function parray_contains_partial(_citext,_text) is 'citext array contains compared by partial';
+
+create or replace function parray_contained_partial(_citext, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contained_partial_ci' language C immutable strict;
+comment on function parray_contained_partial(_citext,_text) is 'citext array contained compared by partial';
+
+create or replace function parray_contains_strict(_citext, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contains_strict_ci' language C immutable strict;
+comment on function parray_contains_strict(_citext,_text) is 'citext array contains compared by strict';
+
+create or replace function parray_contained_strict(_citext, _text) returns bool
+ as 'MODULE_PATHNAME', 'parray_contained_strict_ci' language C immutable strict;
+comment on function parray_contained_strict(_citext,_text) is 'citext array contained compared by strict';
+
+create operator @> (
+  leftarg = _citext,
+  rightarg = _text,
+  procedure = parray_contains_strict,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator <@ (
+  leftarg = _citext,
+  rightarg = _text,
+  procedure = parray_contained_strict,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator @@> (
+  leftarg = _citext,
+  rightarg = _text,
+  procedure = parray_contains_partial,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator <@@ (
+  leftarg = _citext,
+  rightarg = _text,
+  procedure = parray_contained_partial,
+  restrict = contsel,
+  join = contjoinsel
+);
+
+create operator class parray_gin_citext_ops
+for type _citext using gin
+as
+	operator	7		@> (_citext,_text),   -- strict
+	operator	8		<@ (_citext,_text),   -- strict
+	operator	9		@@> (_citext,_text),  -- partial
+	operator	10	<@@ (_citext,_text),  -- partial
+	function	1	parray_gin_compare(internal, internal),
+	function	2	parray_gin_extract_value(internal, internal, internal),
+	function	3	parray_gin_extract_query(internal, internal, internal, internal, internal, internal, internal),
+	function	4	parray_gin_consistent(internal, internal, internal, internal, internal, internal, internal, internal),
+	storage		int4;
+
+-- operator class options, planner support and parallel safety where the
+-- server has them
+
+do $$
+declare
+	f regprocedure;
+begin
+	if current_setting('server_version_num')::int >= 130000 then
+		execute 'alter operator family parray_gin_citext_ops using gin add function 7 (_citext) parray_gin_options(internal)';
+	end if;
+	for f in select unnest(array[
+			'parray_contains_partial(_citext, _text)',
+			'parray_contained_partial(_citext, _text)',
+			'parray_contains_strict(_citext, _text)',
+			'parray_contained_strict(_citext, _text)']::regprocedure[])
+	loop
+		if current_setting('server_version_num')::int >= 120000 then
+			execute 'alter function ' || f::text || ' support parray_support';
+		end if;
+		if current_setting('server_version_num')::int >= 90600 then
+			execute 'alter function ' || f::text || ' parallel safe';
+		end if;
+	end loop;
+end
+$$;
@@ -0,0 +1,53 @@
+-- Index build throughput benchmark.
+--
+-- Run against a scratch database as superuser (log_statement_stats is
+-- superuser-only), for example:
+--   psql -v rows=1000000 -f sql/test-gin-build-performance.sql
+--   psql -v rows=10000000 -f sql/test-gin-build-performance.sql
+--   psql -v rows=100000000 -f sql/test-gin-build-performance.sql
+--
+-- Reports rows per second and index size for each operator class.
+-- Peak memory is printed by log_statement_stats as "max resident size"
+-- right after each create index statement.
+
+\set ON_ERROR_STOP 1
+
+drop extension if exists "parray_gin" cascade;
+create extension "parray_gin";
+
+-- synthetic tags: 1..8 items per row from a vocabulary of 50000 tags
+drop table if exists test_build;
+create table test_build(id bigserial, val text[]);
+insert into test_build(val)
+	select array(select 'tag' || ((i * 7919 + j * 104729) % 50000)
+				 from generate_series(1, 1 + i % 8) j)
+	from generate_series(1, :rows) i;
+vacuum analyze test_build;
+
+select count(*) as rows, pg_size_pretty(pg_relation_size('test_build')) as heap_size
+	from test_build;
+
+set maintenance_work_mem = '1GB';
+set client_min_messages = log;
+
+-- parray_gin_ops
+select clock_timestamp() as build_start \gset
+set log_statement_stats = on;
+create index test_build_idx on test_build using gin (val parray_gin_ops);
+reset log_statement_stats;
+select :rows / extract(epoch from clock_timestamp() - :'build_start'::timestamptz) as rows_per_sec,
+	pg_size_pretty(pg_relation_size('test_build_idx')) as index_size;
+drop index test_build_idx;
+
+-- parray_gin_wide_ops
+select clock_timestamp() as build_start \gset
+set log_statement_stats = on;
+create index test_build_idx on test_build using gin (val parray_gin_wide_ops);
+reset log_statement_stats;
+select :rows / extract(epoch from clock_timestamp() - :'build_start'::timestamptz) as rows_per_sec,
+	pg_size_pretty(pg_relation_size('test_build_idx')) as index_size;
+drop index test_build_idx;
+
+reset client_min_messages;
+reset maintenance_work_mem;
+drop table test_build;
@@ -0,0 +1,73 @@
+-- Parallel query and parallel index build benchmark.
+--
+-- Run against a scratch database with psql 10 or newer, for example:
+--   psql -v rows=10000000 -f sql/test-gin-parallel-performance.sql
+--
+-- Every query is timed with max_parallel_workers_per_gather set to
+-- 0, 1, 2, 4 and 8. Since PostgreSQL 18 the index build is timed with
+-- max_parallel_maintenance_workers set to 0, 2 and 4 as well.
+
+\set ON_ERROR_STOP 1
+\timing on
+
+drop extension if exists "parray_gin" cascade;
+create extension "parray_gin";
+
+-- synthetic tags: 1..8 items per row from a vocabulary of 50000 tags
+drop table if exists test_parallel;
+create table test_parallel(id bigserial, val text[]);
+insert into test_parallel(val)
+	select array(select 'tag' || ((i * 7919 + j * 104729) % 50000)
+				 from generate_series(1, 1 + i % 8) j)
+	from generate_series(1, :rows) i;
+vacuum analyze test_parallel;
+
+select current_setting('server_version_num')::int >= 180000 as parallel_build \gset
+
+-- index build
+set maintenance_work_mem = '1GB';
+\if :parallel_build
+set max_parallel_maintenance_workers = 0;
+create index test_parallel_idx on test_parallel using gin (val parray_gin_ops);
+drop index test_parallel_idx;
+set max_parallel_maintenance_workers = 2;
+create index test_parallel_idx on test_parallel using gin (val parray_gin_ops);
+drop index test_parallel_idx;
+set max_parallel_maintenance_workers = 4;
+\endif
+create index test_parallel_idx on test_parallel using gin (val parray_gin_ops);
+reset max_parallel_maintenance_workers;
+reset maintenance_work_mem;
+
+-- parallel seq scan
+set enable_bitmapscan = off;
+set max_parallel_workers_per_gather = 0;
+select count(*) from test_parallel where val @@> array['tag123%'];
+set max_parallel_workers_per_gather = 1;
+select count(*) from test_parallel where val @@> array['tag123%'];
+set max_parallel_workers_per_gather = 2;
+select count(*) from test_parallel where val @@> array['tag123%'];
+set max_parallel_workers_per_gather = 4;
+select count(*) from test_parallel where val @@> array['tag123%'];
+set max_parallel_workers_per_gather = 8;
+select count(*) from test_parallel where val @@> array['tag123%'];
+explain (analyze, costs off) select count(*) from test_parallel where val @@> array['tag123%'];
+reset enable_bitmapscan;
+
+-- parallel bitmap heap scan, rechecks run in workers
+set enable_seqscan = off;
+set max_parallel_workers_per_gather = 0;
+select count(*) from test_parallel where val @@> array['%ag1%'];
+set max_parallel_workers_per_gather = 1;
+select count(*) from test_parallel where val @@> array['%ag1%'];
+set max_parallel_workers_per_gather = 2;
+select count(*) from test_parallel where val @@> array['%ag1%'];
+set max_parallel_workers_per_gather = 4;
+select count(*) from test_parallel where val @@> array['%ag1%'];
+set max_parallel_workers_per_gather = 8;
+select count(*) from test_parallel where val @@> array['%ag1%'];
+explain (analyze, costs off) select count(*) from test_parallel where val @@> array['%ag1%'];
+reset enable_seqscan;
+
+reset max_parallel_workers_per_gather;
+drop table test_parallel;
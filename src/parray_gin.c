@@ -8,9 +8,15 @@
  * Author: theirix <theirix@gmail.com>
  *
  * GIN index heavily uses trigram implementation from pg_trgm contrib
- * module. Files trgm.c and trgm.h are copied without changes 
- * (excluded only PG_MODULE_MAGIC singleton). We thought postgresql
- * license allows this kind of code reuse.
+ * module. Files trgm.c and trgm.h were copied from it (excluded only
+ * PG_MODULE_MAGIC singleton). We thought postgresql license allows this
+ * kind of code reuse. Changes to the copy:
+ *  - key generation moved from trgm.c to trgm_core.c, which builds
+ *    without a server through trgm_shim.h for the benchmark
+ *  - short keys of one and two characters and the truncated item key
+ *  - wide int8 trigrams of three code points
+ *  - trigrams packed into sorted uint32 keys and intersection kernels
+ *  - hashed word keys
  *
  *-------------------------------------------------------------------------
  */
@@ -24,6 +30,8 @@
 #include "access/skey.h"
 #if PG_VERSION_NUM < 130000
 #include "access/tuptoaster.h"
+#else
+#include "access/reloptions.h"
 #endif
 #include "utils/fmgroids.h"
 #include "utils/builtins.h"
@@ -31,20 +39,56 @@
 #include "utils/timestamp.h"
 #include "utils/array.h"
 #include "utils/lsyscache.h"
+#if PG_VERSION_NUM >= 90400
+#include "utils/jsonb.h"
+#endif
 #include "utils/formatting.h"
 #include "utils/fmgroids.h"
+#include "utils/memutils.h"
+#include "parser/parse_coerce.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "access/hash.h"
+#if PG_VERSION_NUM >= 90300
+#include "access/htup_details.h"
+#endif
+#if PG_VERSION_NUM >= 90400
+#include "access/genam.h"
+#include "access/gin_private.h"
+#include "catalog/pg_am.h"
+#include "storage/bufmgr.h"
+#include "utils/rel.h"
+#endif
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "access/xact.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#if PG_VERSION_NUM >= 90500
+#include "port/atomics.h"
+#endif
+#if PG_VERSION_NUM >= 150000
+#include "common/pg_prng.h"
+#endif
+#include "lib/stringinfo.h"
+#if PG_VERSION_NUM >= 130000
+#include "common/unicode_norm.h"
+#endif
+#if PG_VERSION_NUM >= 120000
+#include "catalog/namespace.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/pathnodes.h"
+#include "nodes/supportnodes.h"
+#include "optimizer/optimizer.h"
+#endif
 
 #include "trgm.h"
 
 PG_MODULE_MAGIC;
 
-/* Log level, usually DEBUG5 (silent) or NOTICE (messages are sent to the
- * client side) */
-#define PARRAY_GIN_TRACE NOTICE
-
-/* Controls logging from GIN functions. A lot of output */
-#define TRACE_LIKE_HELL 0
-
 /*
  * Strategy */
 /* @> operator strategy */
@@ -55,25 +99,275 @@ PG_MODULE_MAGIC;
 #define PARRAY_GIN_STRATEGY_CONTAINS_PARTIAL 9
 /* <@@ operator strategy */
 #define PARRAY_GIN_STRATEGY_CONTAINED_BY_PARTIAL 10
+/* ~@> operator strategy */
+#define PARRAY_GIN_STRATEGY_CONTAINS_WORDS 11
+/* @@~> operator strategy */
+#define PARRAY_GIN_STRATEGY_CONTAINS_UNACCENT 12
+/* <~@@ operator strategy */
+#define PARRAY_GIN_STRATEGY_CONTAINED_BY_UNACCENT 13
+
+/* memory context sizes macro appeared in postgres 9.6 */
+#if PG_VERSION_NUM < 90600
+#define ALLOCSET_DEFAULT_SIZES \
+	ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE
+#endif
+
+/* hash flag for binary keys appeared in postgres 9.5 */
+#if PG_VERSION_NUM < 90500
+#define HASH_BLOBS HASH_FUNCTION
+#endif
+
+/* attribute accessor appeared in postgres 11 and minor releases of 9.x */
+#ifndef TupleDescAttr
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+/* jsonb accessors renamed in postgres 11 */
+#if PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 110000
+#define PG_GETARG_JSONB_P(n) PG_GETARG_JSONB(n)
+#endif
+
+/* expanded arrays appeared in postgres 9.5, accessor renamed in 11 */
+#if PG_VERSION_NUM < 90500
+typedef ArrayType AnyArrayType;
+#define PG_GETARG_ANY_ARRAY_P(n) PG_GETARG_ARRAYTYPE_P(n)
+#define AARR_NDIM(a) ARR_NDIM(a)
+#define AARR_ELEMTYPE(a) ARR_ELEMTYPE(a)
+#define AARR_DIMS(a) ARR_DIMS(a)
+#define VARATT_IS_EXPANDED_HEADER(PTR) false
+#elif PG_VERSION_NUM < 110000
+#define PG_GETARG_ANY_ARRAY_P(n) PG_GETARG_ANY_ARRAY(n)
+#endif
+
+/*
+ * Operator class options, see parray_gin_options
+ */
+typedef struct ParrayGinOptions
+{
+	int32		vl_len_;		/* varlena header (do not touch directly!) */
+	bool		short_keys;		/* index unigrams and bigrams too */
+	bool		unaccent;		/* index items without diacritics */
+	int			max_element_bytes;	/* index only a prefix of longer items */
+} ParrayGinOptions;
+
+/*
+ * Query description shared by all keys of a query, every extra_data
+ * entry points to it
+ */
+typedef struct ParrayGinQuery
+{
+	int32		nitems;			/* number of query items */
+	int32	   *itemKeys;		/* number of keys of each item */
+	bool		truncatedKey;	/* last key is TRUNCATED_KEY */
+	int32		nkeys;			/* keys extracted, for statistics */
+	bool		fullScan;		/* GIN_SEARCH_MODE_ALL, for statistics */
+	bool		counted;		/* statistics have the query */
+	struct ScanTrace *trace;	/* NULL if the scan is not traced */
+} ParrayGinQuery;
+
+/*
+ * Element cache, maps bytes of an indexed item to its keys
+ */
+typedef struct ElementCacheKey
+{
+	uint32		hash;			/* hash of item bytes */
+	int32		len;			/* item length in bytes */
+	uint32		flavor;			/* ELEMENT_CACHE_* flags */
+} ElementCacheKey;
+
+typedef struct ElementCacheEntry
+{
+	ElementCacheKey key;
+	char	   *bytes;			/* item bytes, checked on lookup */
+	int32		nkeys;
+	uint64	   *keys;			/* keys as int32 or int64 values */
+} ElementCacheEntry;
+
+/* flavor flags, keys differ for these */
+#define ELEMENT_CACHE_WIDE			0x01
+#define ELEMENT_CACHE_SHORT_KEYS	0x02
+#define ELEMENT_CACHE_UNACCENT		0x04
+
+/* longer items are rarely repeated, do not cache them */
+#define ELEMENT_CACHE_MAX_BYTES 256
+
+/* GUC parray_gin.element_cache_size, max number of cached items */
+static int	element_cache_size = 0;
+
+static MemoryContext element_cache_context = NULL;
+static HTAB *element_cache = NULL;
+static int64 element_cache_hits = 0;
+static int64 element_cache_misses = 0;
+
+/*
+ * Recheck memo, results of an operator for recently seen left arrays,
+ * kept in fn_extra of the operator
+ */
+typedef struct RecheckMemoSlot
+{
+	uint32		hash;			/* hash of left array bytes */
+	int32		len;			/* left array size, 0 for an empty slot */
+	char	   *bytes;			/* left array, checked on lookup */
+	bool		result;
+} RecheckMemoSlot;
+
+typedef struct RecheckMemo
+{
+	MemoryContext context;		/* holds slots and arrays */
+	int32		nslots;
+	RecheckMemoSlot *slots;		/* direct-mapped by hash */
+	int32		rhslen;
+	char	   *rhs;			/* right array the results are valid for */
+} RecheckMemo;
+
+/* larger arrays are unlikely to repeat byte by byte, do not memoize */
+#define RECHECK_MEMO_MAX_BYTES 2048
+
+/* GUC parray_gin.recheck_memo_size, number of memo slots per operator */
+static int	recheck_memo_size = 0;
+
+/*
+ * Trigrams of the like patterns of an operator call site. An item matches
+ * a pattern only if it has every trigram of the pattern, the property the
+ * index relies on too, so most item and pattern pairs are ruled out
+ * without textlike.
+ */
+typedef struct RecheckPrefilter
+{
+	MemoryContext context;
+	int32		rhslen;
+	char	   *rhs;			/* right array the keys are valid for */
+	uint32	  **keys;			/* packed trigrams of every pattern */
+	int		   *nkeys;
+	bool		useful;			/* some pattern has trigrams */
+} RecheckPrefilter;
+
+/* Packed trigrams of an array element, nkeys is -1 until computed */
+typedef struct ElementKeys
+{
+	uint32	   *keys;
+	int			nkeys;
+} ElementKeys;
+
+/* GUC parray_gin.recheck_prefilter */
+static bool recheck_prefilter = false;
 
-/* oids changed in postgres 14 */
-#if PG_VERSION_NUM < 140000
-#define OID_ARRAY_TO_TEXT_NULL F_ARRAY_TO_TEXT_NULL
+/*
+ * Runtime statistics. Counters are kept in shared memory if the library
+ * is loaded with shared_preload_libraries, per backend otherwise.
+ */
+typedef enum StatsCounter
+{
+	STATS_VALUES,				/* indexed values */
+	STATS_VALUE_KEYS,			/* keys of indexed values */
+	STATS_QUERIES,				/* index queries */
+	STATS_QUERY_KEYS,			/* keys of index queries */
+	STATS_FULL_SCANS,			/* queries with GIN_SEARCH_MODE_ALL */
+	STATS_CONSISTENT,			/* consistent calls */
+	STATS_CANDIDATES,			/* consistent calls returned true */
+	STATS_RECHECKS,				/* operator calls */
+	STATS_MATCHES,				/* operator calls returned true */
+	STATS_MEMO_HITS,			/* operator results taken from the memo */
+	STATS_PREFILTER_SKIPS,		/* item pairs skipped by the prefilter */
+	STATS_COUNTERS
+} StatsCounter;
+
+typedef struct StatsShared
+{
+#if PG_VERSION_NUM >= 90500
+	pg_atomic_uint64 counters[STATS_COUNTERS];
+	pg_atomic_uint64 reset;		/* last reset, a TimestampTz */
 #else
-#define OID_ARRAY_TO_TEXT_NULL F_ARRAY_TO_STRING_ANYARRAY_TEXT_TEXT
+	slock_t		mutex;			/* protects counters and reset */
+	uint64		counters[STATS_COUNTERS];
+	TimestampTz reset;			/* last reset */
+#endif
+} StatsShared;
+
+/* backend changes are added to shared counters after this many events */
+#define STATS_FLUSH_EVENTS 64
+
+static StatsShared *stats_shared = NULL;
+
+/* totals of the backend, or changes not yet flushed to stats_shared */
+static uint64 stats_local[STATS_COUNTERS];
+static int	stats_pending = 0;
+static TimestampTz stats_local_reset = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+
+/*
+ * Tracing, a message per extracted value or query and a summary per
+ * index scan and operator call site, reported when the scan or the
+ * query ends (since 9.5).
+ */
+typedef struct ScanTrace
+{
+	int			level;
+	int			strategy;
+	int32		nkeys;
+	int64		consistent;		/* consistent calls */
+	int64		candidates;		/* consistent calls returned true */
+#if PG_VERSION_NUM >= 90500
+	MemoryContext context;		/* context of the scan keys */
+	MemoryContextCallback callback;
+#endif
+} ScanTrace;
+
+typedef struct OperatorTrace
+{
+	int			level;
+	char	   *name;			/* operator function */
+	int64		calls;
+	int64		matches;
+	int64		memoHits;
+#if PG_VERSION_NUM >= 90500
+	MemoryContextCallback callback;
 #endif
+} OperatorTrace;
+
+/*
+ * State of an operator call site, kept in fn_extra
+ */
+typedef struct OperatorState
+{
+	RecheckMemo *memo;			/* NULL until the memo is used */
+	RecheckPrefilter *prefilter;	/* NULL until the prefilter is used */
+	bool		traceSampled;	/* tracing of the call site is decided */
+	OperatorTrace *trace;		/* NULL if not traced */
+} OperatorState;
+
+/* keys printed in a trace message at most */
+#define TRACE_MAX_KEYS 16
+
+/* GUC parray_gin.trace, message level or zero if tracing is off */
+static int	trace_level = 0;
+
+/* GUC parray_gin.trace_sample_rate, share of traced values and scans */
+static double trace_sample_rate = 1.0;
+
+static const struct config_enum_entry trace_options[] = {
+	{"off", 0, false},
+	{"notice", NOTICE, false},
+	{"log", LOG, false},
+	{NULL, 0, false}
+};
 
 /*
  * Internal functions declarations
  */
 
-bool		is_valid_strategy(int strategy);
-int32	   *palloc_int32(int32 value);
-ArrayType  *construct_bool_array(bool *raw_array, int count);
+void		_PG_init(void);
+static void stats_shmem_startup(void);
+#if PG_VERSION_NUM >= 150000
+static void stats_shmem_request(void);
+#endif
+static void stats_xact_callback(XactEvent event, void *arg);
 
-Datum		dump_op_args(PG_FUNCTION_ARGS);
-Datum		dump_array(PG_FUNCTION_ARGS);
-Datum		trigrams_from_textarray(PG_FUNCTION_ARGS);
+bool		is_valid_strategy(int strategy);
 
 /*
  * Exported functions
@@ -83,11 +377,34 @@ PGDLLEXPORT Datum parray_gin_compare(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum parray_gin_extract_value(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum parray_gin_extract_query(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum parray_gin_consistent(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_options(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_wide_compare(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_wide_extract_value(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_wide_extract_query(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_word_extract_value(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_word_extract_query(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_element_cache_stats(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_stat_counters(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_stat_reset(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_jsonb_extract_value(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_support(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_keys(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_index_keys(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_gin_collisions(PG_FUNCTION_ARGS);
 
 PGDLLEXPORT Datum parray_contains_strict(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum parray_contained_strict(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum parray_contains_partial(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum parray_contained_partial(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_contains_strict_ci(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_contained_strict_ci(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_contains_partial_ci(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_contained_partial_ci(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_jsonb_contains_partial(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_jsonb_contained_partial(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_contains_words(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_contains_partial_ai(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum parray_contained_partial_ai(PG_FUNCTION_ARGS);
 
 /*
  * Declare V1 exports
@@ -97,366 +414,1540 @@ PG_FUNCTION_INFO_V1(parray_gin_compare);
 PG_FUNCTION_INFO_V1(parray_gin_extract_value);
 PG_FUNCTION_INFO_V1(parray_gin_extract_query);
 PG_FUNCTION_INFO_V1(parray_gin_consistent);
+PG_FUNCTION_INFO_V1(parray_gin_options);
+PG_FUNCTION_INFO_V1(parray_gin_wide_compare);
+PG_FUNCTION_INFO_V1(parray_gin_wide_extract_value);
+PG_FUNCTION_INFO_V1(parray_gin_wide_extract_query);
+PG_FUNCTION_INFO_V1(parray_gin_word_extract_value);
+PG_FUNCTION_INFO_V1(parray_gin_word_extract_query);
+PG_FUNCTION_INFO_V1(parray_gin_element_cache_stats);
+PG_FUNCTION_INFO_V1(parray_gin_stat_counters);
+PG_FUNCTION_INFO_V1(parray_gin_stat_reset);
+PG_FUNCTION_INFO_V1(parray_gin_jsonb_extract_value);
+PG_FUNCTION_INFO_V1(parray_support);
+PG_FUNCTION_INFO_V1(parray_gin_keys);
+PG_FUNCTION_INFO_V1(parray_gin_index_keys);
+PG_FUNCTION_INFO_V1(parray_gin_collisions);
 
 PG_FUNCTION_INFO_V1(parray_contains_strict);
 PG_FUNCTION_INFO_V1(parray_contained_strict);
 PG_FUNCTION_INFO_V1(parray_contains_partial);
 PG_FUNCTION_INFO_V1(parray_contained_partial);
+PG_FUNCTION_INFO_V1(parray_contains_strict_ci);
+PG_FUNCTION_INFO_V1(parray_contained_strict_ci);
+PG_FUNCTION_INFO_V1(parray_contains_partial_ci);
+PG_FUNCTION_INFO_V1(parray_contained_partial_ci);
+PG_FUNCTION_INFO_V1(parray_jsonb_contains_partial);
+PG_FUNCTION_INFO_V1(parray_jsonb_contained_partial);
+PG_FUNCTION_INFO_V1(parray_contains_words);
+PG_FUNCTION_INFO_V1(parray_contains_partial_ai);
+PG_FUNCTION_INFO_V1(parray_contained_partial_ai);
 
-PG_FUNCTION_INFO_V1(dump_op_args);
-PG_FUNCTION_INFO_V1(dump_array);
-PG_FUNCTION_INFO_V1(trigrams_from_textarray);
 
-/**
- *
- * Operator support
- *
+/*
+ * Module initialization
  */
-
-static bool
-text_array_contains_partial(ArrayType *array1, ArrayType *array2,
-							Oid collation, bool partial, bool switch_args)
+void
+_PG_init(void)
 {
-	bool		matchall = true;
-	bool		result = matchall;
-	Oid			element_type = ARR_ELEMTYPE(array1);
-	int			nelems1;
-	Datum	   *values2;
-	bool	   *nulls2;
-	int			nelems2;
-	int16		typlen16;
-	int			typlen;
-	bool		typbyval;
-	char		typalign;
-	char	   *ptr1;
-	uint8	   *bitmap1;
-	int			bitmask;
-	int			i;
-	int			j;
-
-	if (element_type != ARR_ELEMTYPE(array2))
-		ereport(ERROR,
-				(errcode(ERRCODE_DATATYPE_MISMATCH),
-				 errmsg("cannot compare arrays of different element types")));
-
-	nelems1 = ArrayGetNItems(ARR_NDIM(array1), ARR_DIMS(array1));
-	ptr1 = ARR_DATA_PTR(array1);
-	bitmap1 = ARR_NULLBITMAP(array1);
-	bitmask = 1;
-
-	if (nelems1 == 0)
-		return true;
-
-	get_typlenbyvalalign(element_type, &typlen16, &typbyval, &typalign);
-	typlen = typlen16;
-
-	/*
-	 * Since we probably will need to scan array2 multiple times, it's
-	 * worthwhile to use deconstruct_array on it.	We scan array1 the hard
-	 * way however, since we very likely won't need to look at all of it.
-	 */
-	deconstruct_array(array2, element_type, typlen, typbyval, typalign,
-					  &values2, &nulls2, &nelems2);
-
-	/* Loop over source data */
+	DefineCustomIntVariable("parray_gin.element_cache_size",
+							"Number of indexed items whose keys are cached "
+							"per backend.",
+							"Zero disables the cache.",
+							&element_cache_size,
+							0, 0, INT_MAX / 2,
+							PGC_USERSET, 0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("parray_gin.recheck_memo_size",
+							"Number of operator results remembered per "
+							"query for repeated arrays.",
+							"Zero disables the memo.",
+							&recheck_memo_size,
+							0, 0, 1024 * 1024,
+							PGC_USERSET, 0,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("parray_gin.recheck_prefilter",
+							 "Skips like matching of items missing trigrams "
+							 "of a pattern in operators.",
+							 NULL,
+							 &recheck_prefilter,
+							 false,
+							 PGC_USERSET, 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomEnumVariable("parray_gin.trace",
+							 "Level of trace messages of key extraction, "
+							 "index scans and operators.",
+							 NULL,
+							 &trace_level,
+							 0, trace_options,
+							 PGC_USERSET, 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomRealVariable("parray_gin.trace_sample_rate",
+							 "Share of traced values, index scans and "
+							 "operator call sites.",
+							 NULL,
+							 &trace_sample_rate,
+							 1.0, 0.0, 1.0,
+							 PGC_USERSET, 0,
+							 NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= 150000
+	MarkGUCPrefixReserved("parray_gin");
+#else
+	EmitWarningsOnPlaceholders("parray_gin");
+#endif
 
-	for (i = 0; i < nelems1; i++)
+	if (process_shared_preload_libraries_in_progress)
 	{
-		Datum		elt1;
-		bool		isnull1;
-
-		/* Get element, checking for NULL */
-		if (bitmap1 && (*bitmap1 & bitmask) == 0)
-		{
-			isnull1 = true;
-			elt1 = (Datum) 0;
-		}
-		else
-		{
-			isnull1 = false;
-			elt1 = fetch_att(ptr1, typbyval, typlen);
-			ptr1 = att_addlength_pointer(ptr1, typlen, ptr1);
-			ptr1 = (char *) att_align_nominal(ptr1, typalign);
-		}
-
-		/* advance bitmap pointer if any */
-		bitmask <<= 1;
-		if (bitmask == 0x100)
-		{
-			if (bitmap1)
-				bitmap1++;
-			bitmask = 1;
-		}
-
-		/*
-		 * We assume that the comparison operator is strict, so a NULL can't
-		 * match anything.	XXX this diverges from the "NULL=NULL" behavior of
-		 * array_eq, should we act like that?
-		 */
-		if (isnull1)
-		{
-			if (matchall)
-			{
-				result = false;
-				break;
-			}
-			continue;
-		}
-
-		for (j = 0; j < nelems2; j++)
-		{
-			Datum		elt2 = values2[j];
-			bool		isnull2 = nulls2[j];
-			bool		oprresult;
-
-			if (isnull2)
-				continue;		/* can't match */
-#if TRACE_LIKE_HELL && 0
-			if (switch_args)
-				elog(PARRAY_GIN_TRACE, " cmp %s vs %s",
-					 TextDatumGetCString(elt2), TextDatumGetCString(elt1));
-			else
-				elog(PARRAY_GIN_TRACE, " cmp %s vs %s",
-					 TextDatumGetCString(elt1), TextDatumGetCString(elt2));
+#if PG_VERSION_NUM >= 150000
+		prev_shmem_request_hook = shmem_request_hook;
+		shmem_request_hook = stats_shmem_request;
+#else
+		RequestAddinShmemSpace(MAXALIGN(sizeof(StatsShared)));
 #endif
-
-			/*
-			 * Apply the operator to the element pair
-			 */
-			if (partial)
-			{
-				if (switch_args)
-					oprresult = DatumGetBool(DirectFunctionCall2Coll(textlike,
-													 collation, elt2, elt1));
-				else
-					oprresult = DatumGetBool(DirectFunctionCall2Coll(textlike,
-													 collation, elt1, elt2));
-			}
-			else
-			{
-				if (switch_args)
-					oprresult = DatumGetBool(DirectFunctionCall2Coll(texteq,
-													 collation, elt2, elt1));
-				else
-					oprresult = DatumGetBool(DirectFunctionCall2Coll(texteq,
-													 collation, elt1, elt2));
-			}
-
-			if (oprresult)
-				break;
-		}
-
-		if (j < nelems2)
-		{
-			/* found a match for elt1 */
-			if (!matchall)
-			{
-				result = true;
-				break;
-			}
-		}
-		else
-		{
-			/* no match for elt1 */
-			if (matchall)
-			{
-				result = false;
-				break;
-			}
-		}
+		prev_shmem_startup_hook = shmem_startup_hook;
+		shmem_startup_hook = stats_shmem_startup;
+		RegisterXactCallback(stats_xact_callback, NULL);
 	}
-
-	pfree(values2);
-	pfree(nulls2);
-
-	return result;
 }
 
-ArrayType *
-construct_bool_array(bool *raw_array, int count)
+#if PG_VERSION_NUM >= 150000
+static void
+stats_shmem_request(void)
 {
-	Oid			elmtype = BOOLOID;
-	int			i;
-	int16		elmlen;
-	bool		elmbyval;
-	char		elmalign;
-	ArrayType  *array;
-	Datum	   *pdatum = (Datum *) palloc(sizeof(Datum) * count);
-
-	for (i = 0; i < count; ++i)
-		pdatum[i] = BoolGetDatum(raw_array[i]);
-	get_typlenbyvalalign(elmtype, &elmlen, &elmbyval, &elmalign);
-	array = construct_array(pdatum, count,
-							elmtype, elmlen, elmbyval, elmalign);
-	pfree(pdatum);
-	return array;
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+	RequestAddinShmemSpace(MAXALIGN(sizeof(StatsShared)));
 }
+#endif
 
-Datum
-dump_array(PG_FUNCTION_ARGS)
+/*
+ * Attach to shared statistics, create them in postmaster
+ */
+static void
+stats_shmem_startup(void)
 {
-	ArrayType  *array = PG_GETARG_ARRAYTYPE_P(0);
-	const char *prefix = PG_GETARG_CSTRING(1);
-	const char *delim = PG_GETARG_CSTRING(2);
-	text	   *tstr;
-	int			nelems;
-
-	tstr = DatumGetTextP(OidFunctionCall3Coll(OID_ARRAY_TO_TEXT_NULL,
-											  PG_GET_COLLATION(),
-											  PointerGetDatum(array),
-											  CStringGetTextDatum(delim),
-											  CStringGetTextDatum("NULL")));
-	nelems = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
-	elog(PARRAY_GIN_TRACE, "%s, count %d, items: %s",
-		 prefix, nelems, text_to_cstring(tstr));
+	bool		found;
+	int			i;
 
-	PG_RETURN_VOID();
-}
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
 
-Datum
-dump_op_args(PG_FUNCTION_ARGS)
-{
-	bool		result = PG_GETARG_BOOL(2);
-	const char *prefix = PG_GETARG_CSTRING(3);
-	char		buf1[1024], buf2[1024];
-
-	snprintf(buf1, sizeof(buf1)-1, "GIN %s lhs", prefix);
-	snprintf(buf2, sizeof(buf2)-1, "GIN %s rhs", prefix);
-	DirectFunctionCall3Coll(dump_array, PG_GET_COLLATION(),
-							PG_GETARG_DATUM(0),
-							CStringGetDatum(buf1),
-							CStringGetDatum("#"));
-	DirectFunctionCall3Coll(dump_array, PG_GET_COLLATION(),
-							PG_GETARG_DATUM(1),
-							CStringGetDatum(buf2),
-							CStringGetDatum("#"));
-	elog(PARRAY_GIN_TRACE, "GIN %s result=%d", prefix, result);
-	PG_RETURN_VOID();
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	stats_shared = ShmemInitStruct("parray_gin stats", sizeof(StatsShared),
+								   &found);
+	if (!found)
+	{
+#if PG_VERSION_NUM >= 90500
+		for (i = 0; i < STATS_COUNTERS; i++)
+			pg_atomic_init_u64(&stats_shared->counters[i], 0);
+		pg_atomic_init_u64(&stats_shared->reset,
+						   (uint64) GetCurrentTimestamp());
+#else
+		SpinLockInit(&stats_shared->mutex);
+		for (i = 0; i < STATS_COUNTERS; i++)
+			stats_shared->counters[i] = 0;
+		stats_shared->reset = GetCurrentTimestamp();
+#endif
+	}
+	LWLockRelease(AddinShmemInitLock);
 }
 
 /*
- * Underlying functions for @> operator
+ * Add backend changes to shared counters
  */
-Datum
-parray_contains_strict(PG_FUNCTION_ARGS)
+static void
+stats_flush(void)
 {
-	ArrayType  *array1 = PG_GETARG_ARRAYTYPE_P(0);
-	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
-	bool		result;
+	int			i;
+
+	if (stats_shared == NULL || stats_pending == 0)
+		return;
 
-	result = text_array_contains_partial(array2, array1,
-										 PG_GET_COLLATION(),
-										 false, false);
-#if TRACE_LIKE_HELL
-	DirectFunctionCall4Coll(dump_op_args, PG_GET_COLLATION(),
-							PointerGetDatum(array1), PointerGetDatum(array2),
-							BoolGetDatum(result),
-							CStringGetDatum("parray_contains_strict"));
+#if PG_VERSION_NUM >= 90500
+	for (i = 0; i < STATS_COUNTERS; i++)
+		if (stats_local[i] > 0)
+			pg_atomic_fetch_add_u64(&stats_shared->counters[i],
+									(int64) stats_local[i]);
+#else
+	SpinLockAcquire(&stats_shared->mutex);
+	for (i = 0; i < STATS_COUNTERS; i++)
+		stats_shared->counters[i] += stats_local[i];
+	SpinLockRelease(&stats_shared->mutex);
 #endif
-	PG_RETURN_BOOL(result);
+	memset(stats_local, 0, sizeof(stats_local));
+	stats_pending = 0;
 }
 
 /*
- * Underlying functions for @@> operator
+ * Flush at transaction end, so short sessions are not lost
  */
-Datum
-parray_contains_partial(PG_FUNCTION_ARGS)
+static void
+stats_xact_callback(XactEvent event, void *arg)
 {
-	ArrayType  *array1 = PG_GETARG_ARRAYTYPE_P(0);
-	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
-	bool		result;
+	stats_flush();
+}
 
-	result = text_array_contains_partial(array2, array1,
-										 PG_GET_COLLATION(),
-										 true, true);
-#if TRACE_LIKE_HELL
-	DirectFunctionCall4Coll(dump_op_args, PG_GET_COLLATION(),
-							PointerGetDatum(array1), PointerGetDatum(array2),
-							BoolGetDatum(result),
-							CStringGetDatum("parray_contains_partial"));
-#endif
-	PG_RETURN_BOOL(result);
+static inline void
+stats_add(StatsCounter counter, uint64 n)
+{
+	stats_local[counter] += n;
+	if (stats_shared != NULL && ++stats_pending >= STATS_FLUSH_EVENTS)
+		stats_flush();
 }
 
 /*
- * Underlying functions for <@ operator
+ * Should the next value, scan or call site be traced
  */
-Datum
-parray_contained_strict(PG_FUNCTION_ARGS)
+static bool
+trace_sampled(void)
 {
-	ArrayType  *array1 = PG_GETARG_ARRAYTYPE_P(0);
-	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
-	bool		result;
-
-	result = text_array_contains_partial(array1, array2,
-										 PG_GET_COLLATION(),
-										 false, true);
-#if TRACE_LIKE_HELL
-	DirectFunctionCall4Coll(dump_op_args, PG_GET_COLLATION(),
-							PointerGetDatum(array1), PointerGetDatum(array2),
-							BoolGetDatum(result),
-							CStringGetDatum("parray_contained_strict"));
+	if (trace_level == 0)
+		return false;
+	if (trace_sample_rate >= 1.0)
+		return true;
+#if PG_VERSION_NUM >= 150000
+	return pg_prng_double(&pg_global_prng_state) < trace_sample_rate;
+#else
+	return (double) random() / ((double) MAX_RANDOM_VALUE + 1) <
+		trace_sample_rate;
 #endif
-	PG_RETURN_BOOL(result);
 }
 
 /*
- * Underlying functions for <@@ operator
+ * Append keys in hex, at most TRACE_MAX_KEYS of them
  */
-Datum
-parray_contained_partial(PG_FUNCTION_ARGS)
+static void
+trace_keys(StringInfo buf, Datum *keys, int32 nkeys, bool wide)
 {
-	ArrayType  *array1 = PG_GETARG_ARRAYTYPE_P(0);
-	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
-	bool		result;
+	int			i;
 
-	result = text_array_contains_partial(array1, array2,
-										 PG_GET_COLLATION(),
-										 true, false);
-#if TRACE_LIKE_HELL
-	DirectFunctionCall4Coll(dump_op_args, PG_GET_COLLATION(),
-							PointerGetDatum(array1), PointerGetDatum(array2),
-							BoolGetDatum(result),
-							CStringGetDatum("parray_contained_partial"));
-#endif
-	PG_RETURN_BOOL(result);
-}
+	appendStringInfoChar(buf, '{');
+	for (i = 0; i < nkeys && i < TRACE_MAX_KEYS; i++)
+	{
+		if (i > 0)
+			appendStringInfoChar(buf, ',');
+		if (wide)
+		{
+			uint64		key = (uint64) DatumGetInt64(keys[i]);
 
+			appendStringInfo(buf, "%x%08x", (uint32) (key >> 32),
+							 (uint32) key);
+		}
+		else
+			appendStringInfo(buf, "%x", (uint32) DatumGetInt32(keys[i]));
+	}
+	if (nkeys > TRACE_MAX_KEYS)
+		appendStringInfoString(buf, ",...");
+	appendStringInfoChar(buf, '}');
+}
 
-/**
- *
- * Is a strategy valid
+#if PG_VERSION_NUM >= 90500
+/*
+ * Memory context callbacks, report when a scan or a query ends.
+ * Nothing is reported on abort. Trace levels are below ERROR, so elog
+ * returns and the context teardown goes on.
  */
-bool
-is_valid_strategy(int strategy)
+static void
+trace_scan_report(void *arg)
 {
-	return
-		strategy == PARRAY_GIN_STRATEGY_CONTAINS ||
-		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY ||
-		strategy == PARRAY_GIN_STRATEGY_CONTAINS_PARTIAL ||
-		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY_PARTIAL;
+	ScanTrace  *trace = (ScanTrace *) arg;
+
+	if (!IsTransactionState())
+		return;
+	elog(trace->level, "parray_gin scan: strategy=%d keys=%d "
+		 "consistent=" INT64_FORMAT " candidates=" INT64_FORMAT,
+		 trace->strategy, trace->nkeys, trace->consistent,
+		 trace->candidates);
 }
 
-int32 *
-palloc_int32(int32 value)
+static void
+trace_operator_report(void *arg)
 {
-	int32	   *p = palloc(sizeof(int32));
+	OperatorTrace *trace = (OperatorTrace *) arg;
 
-	*p = value;
-	return p;
+	if (!IsTransactionState())
+		return;
+	elog(trace->level, "parray_gin recheck: function=%s calls=" INT64_FORMAT
+		 " matches=" INT64_FORMAT " memo_hits=" INT64_FORMAT,
+		 trace->name, trace->calls, trace->matches, trace->memoHits);
 }
+#endif
 
 /*
- * TODO document
+ * Bytes of a string array element. Elements of text, varchar and citext
+ * arrays are varlena, name is a fixed-size NUL-padded string.
  */
-Datum
-trigrams_from_textarray(PG_FUNCTION_ARGS)
+static void
+element_bytes(Datum elt, Oid element_type, char **str, int *len)
 {
-	ArrayType  *items = PG_GETARG_ARRAYTYPE_P(0);
-	int32	   *countTrigrams = (int32 *) PG_GETARG_POINTER(1);
-	bool		useWildcards = (bool) PG_GETARG_BOOL(2);
-	Pointer   **lengthsTrigrams = (Pointer **) PG_GETARG_POINTER(3);
+	if (element_type == NAMEOID)
+	{
+		*str = NameStr(*DatumGetName(elt));
+		*len = strlen(*str);
+	}
+	else
+	{
+		*str = VARDATA_ANY(DatumGetPointer(elt));
+		*len = VARSIZE_ANY_EXHDR(DatumGetPointer(elt));
+	}
+}
+
+/*
+ * Is a code point a combining mark, i.e. one of the diacritical marks
+ * blocks, which hold what NFKD splits off Latin, Greek and Cyrillic letters
+ */
+static inline bool
+is_combining_mark(pg_wchar c)
+{
+	return (c >= 0x0300 && c <= 0x036F) ||
+		(c >= 0x1AB0 && c <= 0x1AFF) ||
+		(c >= 0x1DC0 && c <= 0x1DFF) ||
+		(c >= 0x20D0 && c <= 0x20FF) ||
+		(c >= 0xFE20 && c <= 0xFE2F);
+}
+
+/*
+ * Bytes of a string without diacritics: NFKD decomposition with combining
+ * marks dropped, so "Café" becomes "Cafe". ASCII strings and strings of
+ * other than UTF8 databases are returned as is, otherwise the result is
+ * palloc'd.
+ */
+static char *
+unaccent_bytes(char *str, int len, int *outlen)
+{
+#if PG_VERSION_NUM >= 130000
+	pg_wchar   *input,
+			   *output;
+	char	   *result;
+	int			i,
+				n;
+
+	*outlen = len;
+	if (GetDatabaseEncoding() != PG_UTF8)
+		return str;
+	for (i = 0; i < len; i++)
+		if (IS_HIGHBIT_SET(str[i]))
+			break;
+	if (i == len)
+		return str;
+
+	input = (pg_wchar *) palloc((len + 1) * sizeof(pg_wchar));
+	pg_mb2wchar_with_len(str, input, len);
+	output = unicode_normalize(UNICODE_NFKD, input);
+
+	for (i = 0, n = 0; output[i]; i++)
+		if (!is_combining_mark(output[i]))
+			output[n++] = output[i];
+
+	result = (char *) palloc(n * MAX_MULTIBYTE_CHAR_LEN + 1);
+	*outlen = pg_wchar2mb_with_len(output, result, n);
+
+	pfree(input);
+	pfree(output);
+	return result;
+#else
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("accent-insensitive matching requires PostgreSQL 13")));
+	return NULL;
+#endif
+}
+
+/**
+ *
+ * Operator support
+ *
+ */
+
+/*
+ * Text of an array element to be compared by texteq and textlike.
+ * Names are converted to text, elements are lowercased if icase is set
+ * and lose diacritics if unaccent is set.
+ */
+static Datum
+element_text(Datum elt, Oid element_type, bool icase, bool unaccent,
+			 Oid collation)
+{
+	char	   *str;
+	int			len;
+	char	   *lower;
+	text	   *result;
+
+	if (!icase && !unaccent && element_type != NAMEOID)
+		return elt;
+
+	element_bytes(elt, element_type, &str, &len);
+	if (unaccent)
+		str = unaccent_bytes(str, len, &len);
+	if (!icase)
+		return PointerGetDatum(cstring_to_text_with_len(str, len));
+
+	lower = str_tolower(str, len, OidIsValid(collation)
+						? collation : DEFAULT_COLLATION_OID);
+	result = cstring_to_text(lower);
+	pfree(lower);
+	return PointerGetDatum(result);
+}
+
+/*
+ * Packed trigrams of a text element, computed on first use
+ */
+static ElementKeys *
+element_keys(ElementKeys *ek, Datum elt)
+{
+	if (ek->nkeys < 0)
+	{
+		text	   *txt = DatumGetTextPP(elt);
+		TRGM	   *trg = generate_trgm(VARDATA_ANY(txt),
+										VARSIZE_ANY_EXHDR(txt));
+
+		ek->keys = (uint32 *) palloc(Max(ARRNELEM(trg), 1) * sizeof(uint32));
+		ek->nkeys = trgm_pack(trg, ek->keys);
+		pfree(trg);
+	}
+	return ek;
+}
+
+/*
+ * Does elt1 match any of text items values2, strictly or partially.
+ *
+ * With the prefilter keys1 and keys2 hold trigrams of elt1 and values2,
+ * patterns are elt1 if switch_args is set and values2 otherwise.
+ */
+static bool
+item_matches(Datum elt1, ElementKeys *keys1,
+			 Datum *values2, ElementKeys *keys2, bool *nulls2, int nelems2,
+			 Oid collation, bool partial, bool switch_args)
+{
+	int			j;
+
+	for (j = 0; j < nelems2; j++)
+	{
+		Datum		elt2 = values2[j];
+		bool		isnull2 = nulls2[j];
+		bool		oprresult;
+
+		if (isnull2)
+			continue;		/* can't match */
+
+		if (keys2 != NULL)
+		{
+			ElementKeys *pattern = switch_args ? keys1 : &keys2[j];
+			ElementKeys *item;
+
+			if (pattern->nkeys > 0)
+			{
+				item = switch_args ? element_keys(&keys2[j], elt2)
+					: element_keys(keys1, elt1);
+				if (!keys_contained_by(pattern->keys, pattern->nkeys,
+									   item->keys, item->nkeys))
+				{
+					/* a trigram of the pattern is missing */
+					stats_add(STATS_PREFILTER_SKIPS, 1);
+					continue;
+				}
+			}
+		}
+
+		/*
+		 * Apply the operator to the element pair
+		 */
+		if (partial)
+		{
+			if (switch_args)
+				oprresult = DatumGetBool(DirectFunctionCall2Coll(textlike,
+												 collation, elt2, elt1));
+			else
+				oprresult = DatumGetBool(DirectFunctionCall2Coll(textlike,
+												 collation, elt1, elt2));
+		}
+		else
+		{
+			if (switch_args)
+				oprresult = DatumGetBool(DirectFunctionCall2Coll(texteq,
+												 collation, elt2, elt1));
+			else
+				oprresult = DatumGetBool(DirectFunctionCall2Coll(texteq,
+												 collation, elt1, elt2));
+		}
+
+		if (oprresult)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Sequential access to elements of a flat or an expanded array. Elements
+ * of a flat array are fetched in place, an expanded array is deconstructed
+ * once by its own means, so neither is flattened or copied.
+ */
+typedef struct ArrayWalk
+{
+	Datum	   *values;			/* elements of an expanded array */
+	bool	   *nulls;			/* NULL if there are no nulls */
+	char	   *ptr;			/* next element of a flat array */
+	bits8	   *bitmap;			/* null bitmap of a flat array or NULL */
+	int			bitmask;
+	int			nelems;
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+} ArrayWalk;
+
+static void
+array_walk_init(ArrayWalk *walk, AnyArrayType *array)
+{
+	memset(walk, 0, sizeof(ArrayWalk));
+	walk->nelems = ArrayGetNItems(AARR_NDIM(array), AARR_DIMS(array));
+	get_typlenbyvalalign(AARR_ELEMTYPE(array), &walk->typlen,
+						 &walk->typbyval, &walk->typalign);
+
+#if PG_VERSION_NUM >= 90500
+	if (VARATT_IS_EXPANDED_HEADER(array))
+	{
+		ExpandedArrayHeader *eah = &array->xpn;
+
+		deconstruct_expanded_array(eah);
+		walk->values = eah->dvalues;
+		walk->nulls = eah->dnulls;
+		return;
+	}
+#endif
+
+	walk->ptr = ARR_DATA_PTR((ArrayType *) array);
+	walk->bitmap = ARR_NULLBITMAP((ArrayType *) array);
+	walk->bitmask = 1;
+}
+
+/* Returns i-th element, elements must be fetched in order */
+static Datum
+array_walk_next(ArrayWalk *walk, int i, bool *isnull)
+{
+	Datum		elt;
+
+	if (walk->values)
+	{
+		*isnull = walk->nulls && walk->nulls[i];
+		return *isnull ? (Datum) 0 : walk->values[i];
+	}
+
+	if (walk->bitmap && (*walk->bitmap & walk->bitmask) == 0)
+	{
+		*isnull = true;
+		elt = (Datum) 0;
+	}
+	else
+	{
+		*isnull = false;
+		elt = fetch_att(walk->ptr, walk->typbyval, walk->typlen);
+		walk->ptr = att_addlength_pointer(walk->ptr, walk->typlen, walk->ptr);
+		walk->ptr = (char *) att_align_nominal(walk->ptr, walk->typalign);
+	}
+
+	/* advance bitmap pointer if any */
+	walk->bitmask <<= 1;
+	if (walk->bitmask == 0x100)
+	{
+		if (walk->bitmap)
+			walk->bitmap++;
+		walk->bitmask = 1;
+	}
+
+	return elt;
+}
+
+/*
+ * Elements of an array in palloc'd arrays, like deconstruct_array
+ */
+static void
+array_walk_deconstruct(AnyArrayType *array, Datum **values, bool **nulls,
+					   int *nelems)
+{
+	ArrayWalk	walk;
+	int			i;
+
+	array_walk_init(&walk, array);
+	*nelems = walk.nelems;
+	*values = (Datum *) palloc(Max(walk.nelems, 1) * sizeof(Datum));
+	*nulls = (bool *) palloc(Max(walk.nelems, 1) * sizeof(bool));
+	for (i = 0; i < walk.nelems; i++)
+		(*values)[i] = array_walk_next(&walk, i, &(*nulls)[i]);
+}
+
+/*
+ * Does every item of array1 match some item of array2. Patterns are
+ * array1 if switch_args is set and array2 otherwise, prefilter if not
+ * NULL holds their trigrams.
+ */
+static bool
+text_array_contains_partial(AnyArrayType *array1, AnyArrayType *array2,
+							Oid collation, bool partial, bool switch_args,
+							bool icase, bool unaccent,
+							RecheckPrefilter *prefilter)
+{
+	bool		matchall = true;
+	bool		result = matchall;
+	Oid			element_type = AARR_ELEMTYPE(array1);
+	Oid			element_type2 = AARR_ELEMTYPE(array2);
+	ArrayWalk	walk1;
+	Datum	   *values2;
+	bool	   *nulls2;
+	int			nelems2;
+	ElementKeys *keys2 = NULL;
+	ElementKeys itemKeys;
+	int			i;
+	int			j;
+
+	/* items of name or citext arrays are compared to text patterns */
+	if (element_type != element_type2 &&
+		(TypeCategory(element_type) != TYPCATEGORY_STRING ||
+		 TypeCategory(element_type2) != TYPCATEGORY_STRING))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("cannot compare arrays of different element types")));
+
+	/* collations of a name column and text patterns do not agree */
+	if (!OidIsValid(collation) && element_type == NAMEOID)
+		collation = C_COLLATION_OID;
+
+	array_walk_init(&walk1, array1);
+	if (walk1.nelems == 0)
+		return true;
+
+	/*
+	 * Since we probably will need to scan array2 multiple times, it's
+	 * worthwhile to deconstruct it.  We walk array1 element by element
+	 * however, since we very likely won't need to look at all of it.
+	 */
+	array_walk_deconstruct(array2, &values2, &nulls2, &nelems2);
+	for (j = 0; j < nelems2; j++)
+		if (!nulls2[j])
+			values2[j] = element_text(values2[j], element_type2, icase,
+									  unaccent, collation);
+
+	if (prefilter && prefilter->useful)
+	{
+		keys2 = (ElementKeys *) palloc(Max(nelems2, 1) * sizeof(ElementKeys));
+		for (j = 0; j < nelems2; j++)
+		{
+			keys2[j].keys = switch_args ? NULL : prefilter->keys[j];
+			keys2[j].nkeys = switch_args ? -1 : prefilter->nkeys[j];
+		}
+	}
+
+	/* Loop over source data */
+
+	for (i = 0; i < walk1.nelems; i++)
+	{
+		bool		isnull1;
+		Datum		elt1 = array_walk_next(&walk1, i, &isnull1);
+
+		/*
+		 * We assume that the comparison operator is strict, so a NULL can't
+		 * match anything.	XXX this diverges from the "NULL=NULL" behavior of
+		 * array_eq, should we act like that?
+		 */
+		if (isnull1)
+		{
+			if (matchall)
+			{
+				result = false;
+				break;
+			}
+			continue;
+		}
+
+		elt1 = element_text(elt1, element_type, icase, unaccent, collation);
+
+		if (keys2)
+		{
+			itemKeys.keys = switch_args ? prefilter->keys[i] : NULL;
+			itemKeys.nkeys = switch_args ? prefilter->nkeys[i] : -1;
+		}
+
+		if (item_matches(elt1, keys2 ? &itemKeys : NULL,
+						 values2, keys2, nulls2, nelems2, collation,
+						 partial, switch_args))
+		{
+			/* found a match for elt1 */
+			if (!matchall)
+			{
+				result = true;
+				break;
+			}
+		}
+		else
+		{
+			/* no match for elt1 */
+			if (matchall)
+			{
+				result = false;
+				break;
+			}
+		}
+	}
+
+	pfree(values2);
+	pfree(nulls2);
+	if (keys2)
+		pfree(keys2);
+
+	return result;
+}
+
+/*
+ * Returns state of an operator call site, NULL if none of the memo, the
+ * prefilter and tracing is enabled. Tracing of a call site is sampled once.
+ */
+static OperatorState *
+operator_state_get(FunctionCallInfo fcinfo)
+{
+	FmgrInfo   *flinfo = fcinfo->flinfo;
+	OperatorState *state;
+
+	if (flinfo == NULL || (recheck_memo_size == 0 && trace_level == 0 &&
+						   !recheck_prefilter))
+		return NULL;
+
+	state = (OperatorState *) flinfo->fn_extra;
+	if (state == NULL)
+	{
+		state = (OperatorState *) MemoryContextAllocZero(flinfo->fn_mcxt,
+														 sizeof(OperatorState));
+		flinfo->fn_extra = state;
+	}
+
+	if (trace_level != 0 && !state->traceSampled)
+	{
+		state->traceSampled = true;
+		if (trace_sampled())
+		{
+			OperatorTrace *trace;
+			char	   *name = get_func_name(flinfo->fn_oid);
+
+			trace = (OperatorTrace *) MemoryContextAllocZero(flinfo->fn_mcxt,
+															 sizeof(OperatorTrace));
+			trace->level = trace_level;
+			trace->name = MemoryContextStrdup(flinfo->fn_mcxt,
+											  name ? name : "?");
+#if PG_VERSION_NUM >= 90500
+			trace->callback.func = trace_operator_report;
+			trace->callback.arg = trace;
+			MemoryContextRegisterResetCallback(flinfo->fn_mcxt,
+											   &trace->callback);
+#endif
+			state->trace = trace;
+		}
+	}
+
+	return state;
+}
+
+/*
+ * Counts an operator result in statistics and the trace
+ */
+static inline bool
+operator_result(OperatorState *state, bool result, bool memoHit)
+{
+	stats_add(STATS_RECHECKS, 1);
+	stats_add(STATS_MATCHES, result ? 1 : 0);
+	if (memoHit)
+		stats_add(STATS_MEMO_HITS, 1);
+	if (state != NULL && state->trace != NULL)
+	{
+		state->trace->calls++;
+		state->trace->matches += result ? 1 : 0;
+		state->trace->memoHits += memoHit ? 1 : 0;
+	}
+	return result;
+}
+
+/*
+ * Returns memo of an operator call site valid for the right array,
+ * previous results are forgotten if the right array changes
+ */
+static RecheckMemo *
+recheck_memo_get(OperatorState *state, FmgrInfo *flinfo, ArrayType *rhs)
+{
+	RecheckMemo *memo = state->memo;
+	int32		rhslen = VARSIZE(rhs);
+
+	if (memo == NULL)
+	{
+		memo = (RecheckMemo *) MemoryContextAllocZero(flinfo->fn_mcxt,
+													  sizeof(RecheckMemo));
+		memo->context = AllocSetContextCreate(flinfo->fn_mcxt,
+											  "parray_gin recheck memo",
+											  ALLOCSET_DEFAULT_SIZES);
+		state->memo = memo;
+	}
+
+	if (memo->nslots != recheck_memo_size || memo->rhslen != rhslen ||
+		memcmp(memo->rhs, rhs, rhslen) != 0)
+	{
+		MemoryContextReset(memo->context);
+		memo->nslots = recheck_memo_size;
+		memo->slots = (RecheckMemoSlot *)
+			MemoryContextAllocZero(memo->context,
+								   memo->nslots * sizeof(RecheckMemoSlot));
+		memo->rhs = MemoryContextAlloc(memo->context, rhslen);
+		memcpy(memo->rhs, rhs, rhslen);
+		memo->rhslen = rhslen;
+	}
+
+	return memo;
+}
+
+/*
+ * Returns prefilter of an operator call site valid for the right array of
+ * patterns, trigrams are extracted again if the patterns change
+ */
+static RecheckPrefilter *
+recheck_prefilter_get(OperatorState *state, FmgrInfo *flinfo, ArrayType *rhs)
+{
+	RecheckPrefilter *prefilter = state->prefilter;
+	int32		rhslen = VARSIZE(rhs);
+	MemoryContext oldContext;
+	Oid			element_type = ARR_ELEMTYPE(rhs);
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+	Datum	   *values;
+	bool	   *nulls;
+	int			nelems;
+	int			i;
+
+	if (prefilter == NULL)
+	{
+		prefilter = (RecheckPrefilter *)
+			MemoryContextAllocZero(flinfo->fn_mcxt, sizeof(RecheckPrefilter));
+		prefilter->context = AllocSetContextCreate(flinfo->fn_mcxt,
+												   "parray_gin recheck prefilter",
+												   ALLOCSET_DEFAULT_SIZES);
+		state->prefilter = prefilter;
+	}
+
+	if (prefilter->rhs != NULL && prefilter->rhslen == rhslen &&
+		memcmp(prefilter->rhs, rhs, rhslen) == 0)
+		return prefilter;
+
+	MemoryContextReset(prefilter->context);
+	oldContext = MemoryContextSwitchTo(prefilter->context);
+
+	get_typlenbyvalalign(element_type, &typlen, &typbyval, &typalign);
+	deconstruct_array(rhs, element_type, typlen, typbyval, typalign,
+					  &values, &nulls, &nelems);
+
+	prefilter->keys = (uint32 **) palloc0(Max(nelems, 1) * sizeof(uint32 *));
+	prefilter->nkeys = (int *) palloc0(Max(nelems, 1) * sizeof(int));
+	prefilter->useful = false;
+	for (i = 0; i < nelems; i++)
+	{
+		char	   *str;
+		int			len;
+		TRGM	   *trg;
+
+		if (nulls[i])
+			continue;
+		element_bytes(values[i], element_type, &str, &len);
+		trg = generate_wildcard_trgm(str, len);
+		prefilter->keys[i] = (uint32 *) palloc(Max(ARRNELEM(trg), 1) *
+											   sizeof(uint32));
+		prefilter->nkeys[i] = trgm_pack(trg, prefilter->keys[i]);
+		prefilter->useful |= prefilter->nkeys[i] > 0;
+	}
+
+	prefilter->rhs = palloc(rhslen);
+	memcpy(prefilter->rhs, rhs, rhslen);
+	prefilter->rhslen = rhslen;
+
+	MemoryContextSwitchTo(oldContext);
+	return prefilter;
+}
+
+/*
+ * Applies an operator to the left array1 and the right array2.
+ *
+ * Bitmap heap scans recheck a lot of rows with byte-identical arrays, so
+ * if parray_gin.recheck_memo_size is set, results for small left arrays
+ * are remembered in fn_extra for the duration of a query. Expanded left
+ * arrays, e.g. built by PL/pgSQL, are never flattened for the memo.
+ */
+static bool
+text_array_op(FunctionCallInfo fcinfo, AnyArrayType *array1,
+			  ArrayType *array2, bool contains, bool partial, bool icase,
+			  bool unaccent)
+{
+	OperatorState *state = operator_state_get(fcinfo);
+	RecheckMemo *memo = NULL;
+	RecheckMemoSlot *slot = NULL;
+	RecheckPrefilter *prefilter = NULL;
+	int32		len = 0;
+	uint32		hash = 0;
+	bool		result;
+
+	if (!VARATT_IS_EXPANDED_HEADER(array1))
+		len = VARSIZE(array1);
+
+	if (recheck_memo_size > 0 && state != NULL && len > 0 &&
+		len <= RECHECK_MEMO_MAX_BYTES)
+	{
+		memo = recheck_memo_get(state, fcinfo->flinfo, array2);
+		hash = DatumGetUInt32(hash_any((const unsigned char *) array1, len));
+		slot = &memo->slots[hash % memo->nslots];
+		if (slot->len == len && slot->hash == hash &&
+			memcmp(slot->bytes, array1, len) == 0)
+			return operator_result(state, slot->result, true);
+	}
+
+	/*
+	 * Trigrams of case-insensitive items are not comparable to trigrams of
+	 * patterns lowered with another collation, trigrams of unaccented items
+	 * to trigrams of patterns as given. Like of a nondeterministic
+	 * collation may match different bytes.
+	 */
+	if (recheck_prefilter && partial && !icase && !unaccent && state != NULL
+#if PG_VERSION_NUM >= 120000
+		&& (!OidIsValid(PG_GET_COLLATION()) ||
+			get_collation_isdeterministic(PG_GET_COLLATION()))
+#endif
+		)
+		prefilter = recheck_prefilter_get(state, fcinfo->flinfo, array2);
+
+	if (contains)
+		result = text_array_contains_partial((AnyArrayType *) array2, array1,
+											 PG_GET_COLLATION(),
+											 partial, partial, icase,
+											 unaccent, prefilter);
+	else
+		result = text_array_contains_partial(array1, (AnyArrayType *) array2,
+											 PG_GET_COLLATION(),
+											 partial, !partial, icase,
+											 unaccent, prefilter);
+
+	if (slot)
+	{
+		if (slot->bytes)
+			pfree(slot->bytes);
+		slot->bytes = MemoryContextAlloc(memo->context, len);
+		memcpy(slot->bytes, array1, len);
+		slot->hash = hash;
+		slot->len = len;
+		slot->result = result;
+	}
+
+	return operator_result(state, result, false);
+}
+
+/*
+ * Underlying functions for @> operator
+ */
+Datum
+parray_contains_strict(PG_FUNCTION_ARGS)
+{
+	AnyArrayType *array1 = PG_GETARG_ANY_ARRAY_P(0);
+	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
+	bool		result;
+
+	result = text_array_op(fcinfo, array1, array2, true, false, false, false);
+	PG_RETURN_BOOL(result);
+}
+
+/*
+ * Underlying functions for @@> operator
+ */
+Datum
+parray_contains_partial(PG_FUNCTION_ARGS)
+{
+	AnyArrayType *array1 = PG_GETARG_ANY_ARRAY_P(0);
+	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
+	bool		result;
+
+	result = text_array_op(fcinfo, array1, array2, true, true, false, false);
+	PG_RETURN_BOOL(result);
+}
+
+/*
+ * Underlying functions for <@ operator
+ */
+Datum
+parray_contained_strict(PG_FUNCTION_ARGS)
+{
+	AnyArrayType *array1 = PG_GETARG_ANY_ARRAY_P(0);
+	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
+	bool		result;
+
+	result = text_array_op(fcinfo, array1, array2, false, false, false, false);
+	PG_RETURN_BOOL(result);
+}
+
+/*
+ * Underlying functions for <@@ operator
+ */
+Datum
+parray_contained_partial(PG_FUNCTION_ARGS)
+{
+	AnyArrayType *array1 = PG_GETARG_ANY_ARRAY_P(0);
+	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
+	bool		result;
+
+	result = text_array_op(fcinfo, array1, array2, false, true, false, false);
+	PG_RETURN_BOOL(result);
+}
+
+/*
+ * Case-insensitive operators for citext arrays
+ */
+Datum
+parray_contains_strict_ci(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(text_array_op(fcinfo, PG_GETARG_ANY_ARRAY_P(0),
+								 PG_GETARG_ARRAYTYPE_P(1), true, false, true,
+								 false));
+}
+
+Datum
+parray_contains_partial_ci(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(text_array_op(fcinfo, PG_GETARG_ANY_ARRAY_P(0),
+								 PG_GETARG_ARRAYTYPE_P(1), true, true, true,
+								 false));
+}
+
+Datum
+parray_contained_strict_ci(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(text_array_op(fcinfo, PG_GETARG_ANY_ARRAY_P(0),
+								 PG_GETARG_ARRAYTYPE_P(1), false, false, true,
+								 false));
+}
+
+Datum
+parray_contained_partial_ci(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(text_array_op(fcinfo, PG_GETARG_ANY_ARRAY_P(0),
+								 PG_GETARG_ARRAYTYPE_P(1), false, true, true,
+								 false));
+}
+
+/*
+ * Accent-insensitive partial operators @@~> and <~@@
+ */
+Datum
+parray_contains_partial_ai(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(text_array_op(fcinfo, PG_GETARG_ANY_ARRAY_P(0),
+								 PG_GETARG_ARRAYTYPE_P(1), true, true, false,
+								 true));
+}
+
+Datum
+parray_contained_partial_ai(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(text_array_op(fcinfo, PG_GETARG_ANY_ARRAY_P(0),
+								 PG_GETARG_ARRAYTYPE_P(1), false, true, false,
+								 true));
+}
+
+/*
+ * Does some item of array contain all words of the items of query. Words
+ * are lower-cased and compared whole, as word keys are made.
+ */
+static bool
+text_array_contains_words(AnyArrayType *array, ArrayType *query)
+{
+	ArrayWalk	walk;
+	Datum	   *values;
+	bool	   *nulls;
+	char	  **words = NULL;
+	int			nelems,
+				nwords = 0,
+				i,
+				j,
+				k;
+	bool		result = false;
+
+	array_walk_deconstruct((AnyArrayType *) query, &values, &nulls, &nelems);
+	for (i = 0; i < nelems; i++)
+	{
+		char	   *str;
+		int			len,
+					n;
+		char	  **itemWords;
+
+		if (nulls[i])
+			continue;
+		element_bytes(values[i], ARR_ELEMTYPE(query), &str, &len);
+		itemWords = generate_words(str, len, &n);
+		if (words == NULL)
+			words = (char **) palloc((n + 1) * sizeof(char *));
+		else
+			words = (char **) repalloc(words, (nwords + n + 1) * sizeof(char *));
+		memcpy(words + nwords, itemWords, n * sizeof(char *));
+		nwords += n;
+		pfree(itemWords);
+	}
+
+	/* nothing to look for */
+	if (nwords == 0)
+		return true;
+
+	array_walk_init(&walk, array);
+	for (i = 0; i < walk.nelems && !result; i++)
+	{
+		bool		isnull;
+		Datum		elt = array_walk_next(&walk, i, &isnull);
+		char	   *str;
+		int			len,
+					n;
+		char	  **itemWords;
+
+		if (isnull)
+			continue;
+		element_bytes(elt, AARR_ELEMTYPE(array), &str, &len);
+		itemWords = generate_words(str, len, &n);
+
+		result = true;
+		for (j = 0; j < nwords && result; j++)
+		{
+			for (k = 0; k < n; k++)
+				if (strcmp(words[j], itemWords[k]) == 0)
+					break;
+			result = k < n;
+		}
+
+		for (k = 0; k < n; k++)
+			pfree(itemWords[k]);
+		pfree(itemWords);
+	}
+
+	return result;
+}
+
+/*
+ * Underlying function for ~@> operator
+ */
+Datum
+parray_contains_words(PG_FUNCTION_ARGS)
+{
+	AnyArrayType *array1 = PG_GETARG_ANY_ARRAY_P(0);
+	ArrayType  *array2 = PG_GETARG_ARRAYTYPE_P(1);
+	bool		result;
+
+	result = text_array_contains_words(array1, array2);
+	PG_RETURN_BOOL(operator_result(operator_state_get(fcinfo), result, false));
+}
+
+/*
+ * Does every item of values1 partially match some item of values2
+ */
+static bool
+datums_contain_partial(Datum *values1, bool *nulls1, int nelems1,
+					   Datum *values2, bool *nulls2, int nelems2,
+					   Oid collation, bool switch_args)
+{
+	int			i;
+
+	for (i = 0; i < nelems1; i++)
+		if (nulls1[i] || !item_matches(values1[i], NULL, values2, NULL,
+									   nulls2, nelems2, collation, true,
+									   switch_args))
+			return false;
+	return true;
+}
+
+#if PG_VERSION_NUM >= 90400
+/*
+ * Items of a jsonb array. Strings are pointed in place, other elements
+ * are null items. Anything except an array has no items.
+ */
+static int
+jsonb_string_items(Jsonb *jb, char ***itemStrs, int **itemLens)
+{
+	JsonbIterator *it;
+	JsonbValue	v;
+	int			r;
+	int			count = 0;
+	int			n = 0;
+
+	if (JB_ROOT_IS_ARRAY(jb) && !JB_ROOT_IS_SCALAR(jb))
+		n = JB_ROOT_COUNT(jb);
+
+	*itemStrs = (char **) palloc0(Max(n, 1) * sizeof(char *));
+	*itemLens = (int *) palloc0(Max(n, 1) * sizeof(int));
+	if (n == 0)
+		return 0;
+
+	it = JsonbIteratorInit(&jb->root);
+	while ((r = JsonbIteratorNext(&it, &v, true)) != WJB_DONE)
+	{
+		if (r != WJB_ELEM)
+			continue;
+		if (v.type == jbvString)
+		{
+			(*itemStrs)[count] = v.val.string.val;
+			(*itemLens)[count] = v.val.string.len;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Matches string items of a jsonb array to text patterns, without
+ * building an intermediate text array
+ */
+static bool
+jsonb_contains_partial(FunctionCallInfo fcinfo, Jsonb *jb,
+					   ArrayType *patterns, bool contains)
+{
+	Oid			collation = PG_GET_COLLATION();
+	char	  **itemStrs;
+	int		   *itemLens;
+	int			nitems;
+	Datum	   *items;
+	bool	   *itemNulls;
+	Datum	   *values;
+	bool	   *nulls;
+	int			nvalues;
+	int			i;
+	bool		result;
+
+	/* scalars and objects are not arrays of items, match neither way */
+	if (!JB_ROOT_IS_ARRAY(jb) || JB_ROOT_IS_SCALAR(jb))
+		return operator_result(operator_state_get(fcinfo), false, false);
+
+	nitems = jsonb_string_items(jb, &itemStrs, &itemLens);
+	items = (Datum *) palloc(Max(nitems, 1) * sizeof(Datum));
+	itemNulls = (bool *) palloc(Max(nitems, 1) * sizeof(bool));
+	for (i = 0; i < nitems; i++)
+	{
+		itemNulls[i] = itemStrs[i] == NULL;
+		if (itemStrs[i])
+			items[i] = PointerGetDatum(cstring_to_text_with_len(itemStrs[i],
+																itemLens[i]));
+	}
+
+	deconstruct_array(patterns, TEXTOID, -1, false, 'i',
+					  &values, &nulls, &nvalues);
+
+	if (contains)
+		result = datums_contain_partial(values, nulls, nvalues,
+										items, itemNulls, nitems,
+										collation, true);
+	else
+		result = datums_contain_partial(items, itemNulls, nitems,
+										values, nulls, nvalues,
+										collation, false);
+
+	pfree(values);
+	pfree(nulls);
+	return operator_result(operator_state_get(fcinfo), result, false);
+}
+#endif
+
+/*
+ * Underlying functions for jsonb @@> text[] operator
+ */
+Datum
+parray_jsonb_contains_partial(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 90400
+	PG_RETURN_BOOL(jsonb_contains_partial(fcinfo, PG_GETARG_JSONB_P(0),
+										  PG_GETARG_ARRAYTYPE_P(1), true));
+#else
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("jsonb requires PostgreSQL 9.4")));
+	PG_RETURN_BOOL(false);
+#endif
+}
+
+/*
+ * Underlying functions for jsonb <@@ text[] operator
+ */
+Datum
+parray_jsonb_contained_partial(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 90400
+	PG_RETURN_BOOL(jsonb_contains_partial(fcinfo, PG_GETARG_JSONB_P(0),
+										  PG_GETARG_ARRAYTYPE_P(1), false));
+#else
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("jsonb requires PostgreSQL 9.4")));
+	PG_RETURN_BOOL(false);
+#endif
+}
+
+/**
+ *
+ * Is a strategy valid
+ */
+bool
+is_valid_strategy(int strategy)
+{
+	return
+		strategy == PARRAY_GIN_STRATEGY_CONTAINS ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINS_PARTIAL ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY_PARTIAL ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINS_WORDS ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINS_UNACCENT ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY_UNACCENT;
+}
+
+/*
+ * Fetch operator class options of the index, defaults if none given
+ */
+static void
+get_gin_options(FunctionCallInfo fcinfo, ParrayGinOptions *options)
+{
+	memset(options, 0, sizeof(ParrayGinOptions));
+#if PG_VERSION_NUM >= 130000
+	if (PG_HAS_OPCLASS_OPTIONS())
+		memcpy(options, PG_GET_OPCLASS_OPTIONS(), sizeof(ParrayGinOptions));
+#endif
+}
+
+/*
+ * Element cache
+ *
+ * Tag arrays usually draw from a small vocabulary, so index build and
+ * inserts extract keys of the same items over and over. Keys of short
+ * value items are kept in a per-backend hash table bounded by
+ * parray_gin.element_cache_size; the table is dropped as a whole when full.
+ */
+
+static void
+element_cache_reset(void)
+{
+	if (element_cache)
+		hash_destroy(element_cache);
+	element_cache = NULL;
+	if (element_cache_context)
+		MemoryContextReset(element_cache_context);
+}
+
+static ElementCacheKey
+element_cache_key(const char *str, int slen, uint32 flavor)
+{
+	ElementCacheKey key;
+
+	memset(&key, 0, sizeof(key));
+	key.hash = DatumGetUInt32(hash_any((const unsigned char *) str, slen));
+	key.len = slen;
+	key.flavor = flavor;
+	return key;
+}
+
+/*
+ * Looks up keys of an item, returns NULL if not cached
+ */
+static ElementCacheEntry *
+element_cache_lookup(const char *str, int slen, uint32 flavor)
+{
+	ElementCacheKey key;
+	ElementCacheEntry *entry;
+
+	if (element_cache)
+	{
+		key = element_cache_key(str, slen, flavor);
+		entry = (ElementCacheEntry *) hash_search(element_cache, &key,
+												  HASH_FIND, NULL);
+		if (entry && memcmp(entry->bytes, str, slen) == 0)
+		{
+			element_cache_hits++;
+			return entry;
+		}
+	}
+
+	element_cache_misses++;
+	return NULL;
+}
+
+/*
+ * Remembers keys of an item
+ */
+static void
+element_cache_store(const char *str, int slen, uint32 flavor,
+					Datum *keys, int nkeys, bool wide)
+{
+	ElementCacheKey key;
+	ElementCacheEntry *entry;
+	bool		found;
+	int			i;
+
+	if (element_cache && hash_get_num_entries(element_cache) >= element_cache_size)
+		element_cache_reset();
+
+	if (!element_cache)
+	{
+		HASHCTL		ctl;
+
+		if (!element_cache_context)
+			element_cache_context = AllocSetContextCreate(TopMemoryContext,
+														  "parray_gin element cache",
+														  ALLOCSET_DEFAULT_SIZES);
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(ElementCacheKey);
+		ctl.entrysize = sizeof(ElementCacheEntry);
+		ctl.hcxt = element_cache_context;
+#if PG_VERSION_NUM < 90500
+		ctl.hash = tag_hash;
+#endif
+		element_cache = hash_create("parray_gin element cache",
+									Min(element_cache_size, 1024), &ctl,
+									HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	key = element_cache_key(str, slen, flavor);
+	entry = (ElementCacheEntry *) hash_search(element_cache, &key,
+											  HASH_ENTER, &found);
+	if (found)
+	{
+		/* hash collision, replace older item */
+		pfree(entry->bytes);
+		pfree(entry->keys);
+	}
+
+	entry->bytes = MemoryContextAlloc(element_cache_context, Max(slen, 1));
+	memcpy(entry->bytes, str, slen);
+	entry->nkeys = nkeys;
+	entry->keys = MemoryContextAlloc(element_cache_context,
+									 Max(nkeys, 1) * sizeof(uint64));
+	for (i = 0; i < nkeys; i++)
+		entry->keys[i] = wide ? (uint64) DatumGetInt64(keys[i])
+			: (uint64) (uint32) DatumGetInt32(keys[i]);
+}
+
+/*
+ * Element cache statistics: hits, misses, cached items
+ */
+Datum
+parray_gin_element_cache_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[3];
+	bool		isnull[3] = {false, false, false};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	values[0] = Int64GetDatum(element_cache_hits);
+	values[1] = Int64GetDatum(element_cache_misses);
+	values[2] = Int64GetDatum(element_cache
+							  ? (int64) hash_get_num_entries(element_cache)
+							  : 0);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values,
+													  isnull)));
+}
+
+/*
+ * Runtime statistics: shared flag, counters in StatsCounter order and
+ * time of the last reset
+ */
+Datum
+parray_gin_stat_counters(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[STATS_COUNTERS + 2];
+	bool		isnull[STATS_COUNTERS + 2];
+	TimestampTz reset;
+	int			i;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	memset(isnull, 0, sizeof(isnull));
+	values[0] = BoolGetDatum(stats_shared != NULL);
+	if (stats_shared)
+	{
+		stats_flush();
+#if PG_VERSION_NUM >= 90500
+		for (i = 0; i < STATS_COUNTERS; i++)
+			values[i + 1] = Int64GetDatum((int64)
+				pg_atomic_read_u64(&stats_shared->counters[i]));
+		reset = (TimestampTz) pg_atomic_read_u64(&stats_shared->reset);
+#else
+		SpinLockAcquire(&stats_shared->mutex);
+		for (i = 0; i < STATS_COUNTERS; i++)
+			values[i + 1] = Int64GetDatum((int64) stats_shared->counters[i]);
+		reset = stats_shared->reset;
+		SpinLockRelease(&stats_shared->mutex);
+#endif
+	}
+	else
+	{
+		for (i = 0; i < STATS_COUNTERS; i++)
+			values[i + 1] = Int64GetDatum((int64) stats_local[i]);
+		reset = stats_local_reset;
+	}
+	values[STATS_COUNTERS + 1] = TimestampTzGetDatum(reset);
+	isnull[STATS_COUNTERS + 1] = reset == 0;
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values,
+													  isnull)));
+}
 
+/*
+ * Reset runtime statistics, returns time of the reset
+ */
+Datum
+parray_gin_stat_reset(PG_FUNCTION_ARGS)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	int			i;
+
+	memset(stats_local, 0, sizeof(stats_local));
+	stats_pending = 0;
+	if (stats_shared)
+	{
+#if PG_VERSION_NUM >= 90500
+		for (i = 0; i < STATS_COUNTERS; i++)
+			pg_atomic_write_u64(&stats_shared->counters[i], 0);
+		pg_atomic_write_u64(&stats_shared->reset, (uint64) now);
+#else
+		SpinLockAcquire(&stats_shared->mutex);
+		for (i = 0; i < STATS_COUNTERS; i++)
+			stats_shared->counters[i] = 0;
+		stats_shared->reset = now;
+		SpinLockRelease(&stats_shared->mutex);
+#endif
+	}
+	else
+		stats_local_reset = now;
+
+	PG_RETURN_TIMESTAMPTZ(now);
+}
+
+/*
+ * Extract keys from items given as strings, int32 trigrams or
+ * int64 wide trigrams. NULL string is a null item.
+ *
+ * Items of a query are parsed as like expressions if useWildcards is set.
+ * Short keys are added for every indexed item if enabled by options, for
+ * query items only when an item gives no trigrams at all.
+ * Indexed items longer than max_element_bytes option are cut, such values
+ * get TRUNCATED_KEY.
+ * If itemCounts is not NULL, it receives number of keys for each item.
+ */
+static Datum *
+trigrams_from_items(char **itemStrs, int *itemLens, int32 countItemKeys,
+					ParrayGinOptions *options, bool wide, bool isQuery,
+					bool useWildcards, int32 *countTrigrams,
+					int32 **itemCounts)
+{
 	/*
 	 * Result type, contains int32 datums with all trigrams for all indexed
 	 * strings from a value
@@ -467,14 +1958,170 @@ trigrams_from_textarray(PG_FUNCTION_ARGS)
 	size_t		countArrTrigram = 0;
 	size_t		i;
 
+	MemoryContext itemContext;
+	MemoryContext oldContext;
+	bool		truncated = false;
+	uint32		flavor = (wide ? ELEMENT_CACHE_WIDE : 0) |
+		(options->short_keys ? ELEMENT_CACHE_SHORT_KEYS : 0) |
+		(options->unaccent ? ELEMENT_CACHE_UNACCENT : 0);
+
+	*countTrigrams = 0;
+
+	/* cache was disabled, free it */
+	if (element_cache_size == 0 && element_cache)
+		element_cache_reset();
+
+	/*
+	 * Preallocate array. Without short keys an item of n bytes never gives
+	 * more than n + 2 trigrams, check for overflow later anyway.
+	 */
+	for (indexKey = 0; indexKey < countItemKeys; ++indexKey)
+		if (itemStrs[indexKey])
+			countArrTrigram += 2 + itemLens[indexKey];
+	keys = (Datum *) palloc(Max(countArrTrigram, 1) * sizeof(Datum));
+
+	if (itemCounts)
+		*itemCounts = (int32 *) palloc0((1 + countItemKeys) * sizeof(int32));
+
+	/*
+	 * Trigram generation allocates a lot for each item, so do it in
+	 * a separate context reset after every item. Huge arrays are extracted
+	 * in bounded memory then.
+	 */
+	itemContext = AllocSetContextCreate(CurrentMemoryContext,
+										"parray_gin item extraction",
+										ALLOCSET_DEFAULT_SIZES);
+
+	for (indexKey = 0; indexKey < countItemKeys; ++indexKey)
+	{
+		char	   *pstr;
+		int			slen;
+		uint64	   *itemKeys;
+		int			countItem;
+		int32		firstKey;
+		bool		useCache;
+
+		if (!itemStrs[indexKey])
+			continue;
+
+		pstr = itemStrs[indexKey];
+		slen = itemLens[indexKey];
+
+		if (!isQuery && options->max_element_bytes > 0 &&
+			slen > options->max_element_bytes)
+		{
+			slen = pg_mbcliplen(pstr, slen, options->max_element_bytes);
+			truncated = true;
+		}
+
+		useCache = !isQuery && element_cache_size > 0 &&
+			slen <= ELEMENT_CACHE_MAX_BYTES;
+		if (useCache)
+		{
+			ElementCacheEntry *entry = element_cache_lookup(pstr, slen,
+															flavor);
+
+			if (entry)
+			{
+				if (itemCounts)
+					(*itemCounts)[indexKey] = entry->nkeys;
+				if (*countTrigrams + entry->nkeys > (int32) countArrTrigram)
+				{
+					countArrTrigram = Max(2 * countArrTrigram,
+										  (size_t) (*countTrigrams + entry->nkeys));
+					keys = (Datum *) repalloc(keys,
+											  countArrTrigram * sizeof(Datum));
+				}
+				for (i = 0; i < (size_t) entry->nkeys; i++)
+					keys[(*countTrigrams)++] = wide
+						? Int64GetDatum((int64) entry->keys[i])
+						: Int32GetDatum((int32) entry->keys[i]);
+				continue;
+			}
+		}
+
+		oldContext = MemoryContextSwitchTo(itemContext);
+		if (options->unaccent)
+		{
+			int			ulen;
+			char	   *ustr = unaccent_bytes(pstr, slen, &ulen);
+
+			itemKeys = generate_item_keys(ustr, ulen, wide, isQuery,
+										  useWildcards, options->short_keys,
+										  &countItem);
+		}
+		else
+			itemKeys = generate_item_keys(pstr, slen, wide, isQuery,
+										  useWildcards, options->short_keys,
+										  &countItem);
+		MemoryContextSwitchTo(oldContext);
+
+		if (itemCounts)
+			(*itemCounts)[indexKey] = countItem;
+
+		/* grow on need */
+		if (*countTrigrams + countItem > (int32) countArrTrigram)
+		{
+			countArrTrigram = Max(2 * countArrTrigram,
+								  (size_t) (*countTrigrams + countItem));
+			keys = (Datum *) repalloc(keys, countArrTrigram * sizeof(Datum));
+		}
+
+		firstKey = *countTrigrams;
+		for (i = 0; i < (size_t) countItem; i++)
+			keys[(*countTrigrams)++] = wide
+				? Int64GetDatum((int64) itemKeys[i])
+				: Int32GetDatum((int32) itemKeys[i]);
+
+		if (useCache)
+			element_cache_store(pstr, slen, flavor, keys + firstKey,
+								countItem, wide);
+
+		MemoryContextReset(itemContext);
+	}
+
+	MemoryContextDelete(itemContext);
+
+	if (truncated)
+	{
+		if (*countTrigrams + 1 > (int32) countArrTrigram)
+		{
+			countArrTrigram = *countTrigrams + 1;
+			keys = (Datum *) repalloc(keys, countArrTrigram * sizeof(Datum));
+		}
+		keys[(*countTrigrams)++] = wide
+			? Int64GetDatum(WIDE_SHORTKEY_FLAG | TRUNCATED_KEY)
+			: Int32GetDatum(TRUNCATED_KEY);
+	}
+
+	/* give back a large overestimate, e.g. for items with long words */
+	if (countArrTrigram > 1024 && (size_t) *countTrigrams < countArrTrigram / 2)
+		keys = (Datum *) repalloc(keys,
+								  Max(*countTrigrams, 1) * sizeof(Datum));
+
+
+	return keys;
+}
+
+/*
+ * Extract keys from all items of a text array, see trigrams_from_items
+ */
+static Datum *
+trigrams_from_textarray(ArrayType *items, Oid collation,
+						ParrayGinOptions *options, bool wide, bool isQuery,
+						bool useWildcards, int32 *countTrigrams,
+						int32 **itemCounts)
+{
+	Datum	   *keys;
 	Datum	   *itemKeys;
 	bool	   *itemNullFlags = NULL;
 	int32		countItemKeys;
+	char	  **itemStrs;
+	int		   *itemLens;
 	int16		elmlen;
 	bool		elmbyval;
 	char		elmalign;
-
-	*countTrigrams = 0;
+	int			i;
 
 	get_typlenbyvalalign(ARR_ELEMTYPE(items),
 						 &elmlen, &elmbyval, &elmalign);
@@ -483,97 +2130,606 @@ trigrams_from_textarray(PG_FUNCTION_ARGS)
 					  elmlen, elmbyval, elmalign,
 					  &itemKeys, &itemNullFlags, &countItemKeys);
 
-	/*
-	 * preallocate array, it's a upper bound estimate but check for overflow
-	 * later anyway
-	 */
-	for (indexKey = 0; indexKey < countItemKeys; ++indexKey)
-		if (!itemNullFlags[indexKey])
-			countArrTrigram += 2 +
-				DatumGetInt32(OidFunctionCall1Coll(F_TEXTLEN,
-									PG_GET_COLLATION(), itemKeys[indexKey]));
-	keys = (Datum *) palloc(countArrTrigram * sizeof(TRGM));
+	itemStrs = (char **) palloc0(Max(countItemKeys, 1) * sizeof(char *));
+	itemLens = (int *) palloc0(Max(countItemKeys, 1) * sizeof(int));
+	for (i = 0; i < countItemKeys; ++i)
+		if (!itemNullFlags[i])
+			element_bytes(itemKeys[i], ARR_ELEMTYPE(items),
+						  &itemStrs[i], &itemLens[i]);
+
+	keys = trigrams_from_items(itemStrs, itemLens, countItemKeys, options,
+							   wide, isQuery, useWildcards, countTrigrams,
+							   itemCounts);
+
+	pfree(itemStrs);
+	pfree(itemLens);
+	pfree(itemKeys);
+	pfree(itemNullFlags);
+
+	return keys;
+}
 
-	if (lengthsTrigrams)
+/*
+ * Word keys of all items of a text array. Keys are not unique, GIN sorts
+ * them out.
+ */
+static Datum *
+words_from_textarray(ArrayType *items, int32 *countKeys)
+{
+	Datum	   *keys;
+	Datum	   *itemValues;
+	bool	   *itemNulls;
+	int			nitems,
+				maxkeys = 16,
+				i,
+				j;
+
+	array_walk_deconstruct((AnyArrayType *) items, &itemValues, &itemNulls,
+						   &nitems);
+
+	keys = (Datum *) palloc(maxkeys * sizeof(Datum));
+	*countKeys = 0;
+	for (i = 0; i < nitems; i++)
 	{
-		*lengthsTrigrams = (Pointer *) palloc0(
-									  (1 + countItemKeys) * sizeof(Pointer));
-		(*lengthsTrigrams)[0] = (Pointer) palloc_int32(countItemKeys);
+		char	   *str;
+		int			len,
+					nkeys;
+		uint32	   *itemKeys;
+
+		if (itemNulls[i])
+			continue;
+		element_bytes(itemValues[i], ARR_ELEMTYPE(items), &str, &len);
+		itemKeys = generate_word_keys(str, len, &nkeys);
+		if (*countKeys + nkeys > maxkeys)
+		{
+			maxkeys = 2 * maxkeys + nkeys;
+			keys = (Datum *) repalloc(keys, maxkeys * sizeof(Datum));
+		}
+		for (j = 0; j < nkeys; j++)
+			keys[(*countKeys)++] = Int32GetDatum((int32) itemKeys[j]);
+		pfree(itemKeys);
 	}
-	for (indexKey = 0; indexKey < countItemKeys; ++indexKey)
+
+	pfree(itemValues);
+	pfree(itemNulls);
+	return keys;
+}
+
+/**
+ *
+ * Introspection
+ *
+ */
+
+/*
+ * Kind and readable form of an int4 key. Fragments of printable ASCII
+ * are shown as is, others (hashed multibyte fragments) in hex.
+ * Returns NULL for the truncated value key.
+ */
+static text *
+key_decode(uint32 key, const char **kind)
+{
+	uint32		kindbits = key >> SHORTKEY_KIND_SHIFT;
+	uint32		payload = key & 0xFFFFFF;
+	unsigned char bytes[3];
+	int			nbytes = 0;
+	int			i;
+	char		buf[16];
+
+	switch (kindbits)
 	{
-		char	   *pstr;
-		TRGM	   *trg;
-		trgm	   *ptr;
-		int32		item;
+		case 0:
+			*kind = "trigram";
+			break;
+		case SHORTKEY_UNIGRAM:
+			*kind = "unigram";
+			break;
+		case SHORTKEY_BIGRAM:
+			*kind = "bigram";
+			break;
+		default:
+			*kind = key == TRUNCATED_KEY ? "truncated" : "unknown";
+			return NULL;
+	}
+
+	/* trigrams always have three bytes, short keys drop leading zeros */
+	for (i = 2; i >= 0; i--)
+	{
+		unsigned char b = (payload >> (8 * i)) & 0xFF;
+
+		if (nbytes == 0 && b == 0 && kindbits != 0 && i > 0)
+			continue;
+		bytes[nbytes++] = b;
+	}
+	for (i = 0; i < nbytes; i++)
+		if (bytes[i] < 0x20 || bytes[i] > 0x7E)
+			break;
+	if (i < nbytes)
+	{
+		snprintf(buf, sizeof(buf), "0x%06x", payload);
+		return cstring_to_text(buf);
+	}
+	return cstring_to_text_with_len((char *) bytes, nbytes);
+}
+
+/*
+ * Keys which parray_gin_ops makes of items, or of patterns if the second
+ * argument is set: (item, key, kind, trigram)
+ */
+Datum
+parray_gin_keys(PG_FUNCTION_ARGS)
+{
+	typedef struct
+	{
+		Datum	   *keys;
+		int32		nkeys;
+		int32	   *itemCounts;
+		int32		item;		/* current item */
+		int32		itemEnd;	/* first key of the next item */
+	} KeysState;
+
+	FuncCallContext *funcctx;
+	KeysState  *state;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		ArrayType  *items = PG_GETARG_ARRAYTYPE_P(0);
+		bool		patterns = PG_GETARG_BOOL(1);
+		ParrayGinOptions options;
+		TupleDesc	tupdesc;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		memset(&options, 0, sizeof(options));
+		options.short_keys = PG_GETARG_BOOL(2);
+		state = (KeysState *) palloc0(sizeof(KeysState));
+		state->keys = trigrams_from_textarray(items, PG_GET_COLLATION(),
+											  &options, false, patterns,
+											  patterns, &state->nkeys,
+											  &state->itemCounts);
+		state->itemEnd = state->itemCounts[0];
+		funcctx->user_fctx = state;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (KeysState *) funcctx->user_fctx;
+
+	if (funcctx->call_cntr < (uint64) state->nkeys)
+	{
+		uint32		key = (uint32) DatumGetInt32(state->keys[funcctx->call_cntr]);
+		const char *kind;
+		text	   *trigram;
+		Datum		values[4];
+		bool		isnull[4] = {false, false, false, false};
+
+		/* skip items without keys too */
+		while ((int32) funcctx->call_cntr >= state->itemEnd)
+			state->itemEnd += state->itemCounts[++state->item];
+
+		trigram = key_decode(key, &kind);
+		values[0] = Int32GetDatum(state->item + 1);
+		values[1] = Int32GetDatum((int32) key);
+		values[2] = CStringGetTextDatum(kind);
+		values[3] = PointerGetDatum(trigram);
+		isnull[3] = trigram == NULL;
+
+		SRF_RETURN_NEXT(funcctx,
+						HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc,
+														  values, isnull)));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+#if PG_VERSION_NUM >= 90400
+/* page of a buffer, 9.6 checks snapshot age there */
+#if PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 100000
+#define GinBufferGetPage(buffer) \
+	BufferGetPage(buffer, NULL, NULL, BGP_NO_SNAPSHOT_TEST)
+#else
+#define GinBufferGetPage(buffer) BufferGetPage(buffer)
+#endif
+
+typedef struct IndexKeyEntry
+{
+	uint32		key;
+	int64		postings;		/* heap pointers of the key */
+	int32		pages;			/* posting tree pages, 0 for a posting list */
+	BlockNumber root;			/* posting tree root or InvalidBlockNumber */
+} IndexKeyEntry;
+
+static int
+index_key_cmp(const void *a, const void *b)
+{
+	const IndexKeyEntry *ea = (const IndexKeyEntry *) a;
+	const IndexKeyEntry *eb = (const IndexKeyEntry *) b;
+
+	if (ea->postings != eb->postings)
+		return ea->postings > eb->postings ? -1 : 1;
+	return ea->key < eb->key ? -1 : (ea->key > eb->key ? 1 : 0);
+}
+
+/*
+ * Counts items and pages of a posting tree, walks down the leftmost path
+ * and then the leaf level
+ */
+static void
+posting_tree_size(Relation index, IndexKeyEntry *entry)
+{
+	BlockNumber blkno = entry->root;
+	Buffer		buffer;
+	Page		page;
+
+	for (;;)
+	{
+		CHECK_FOR_INTERRUPTS();
+		buffer = ReadBuffer(index, blkno);
+		LockBuffer(buffer, GIN_SHARE);
+		page = GinBufferGetPage(buffer);
+		entry->pages++;
+		if (GinPageIsLeaf(page))
+			break;
+		blkno = PostingItemGetBlockNumber(
+			GinDataPageGetPostingItem(page, FirstOffsetNumber));
+		UnlockReleaseBuffer(buffer);
+	}
+
+	for (;;)
+	{
+		if (!GinPageIsDeleted(page))
+		{
+			ItemPointerData minItem;
+			ItemPointer items;
+			int			nitems;
+
+			ItemPointerSetMin(&minItem);
+			items = GinDataLeafPageGetItems(page, &nitems, minItem);
+			entry->postings += nitems;
+			if (items)
+				pfree(items);
+		}
+		blkno = GinPageGetOpaque(page)->rightlink;
+		UnlockReleaseBuffer(buffer);
+		if (blkno == InvalidBlockNumber)
+			break;
+
+		CHECK_FOR_INTERRUPTS();
+		buffer = ReadBuffer(index, blkno);
+		LockBuffer(buffer, GIN_SHARE);
+		page = GinBufferGetPage(buffer);
+		entry->pages++;
+	}
+}
+
+/*
+ * Collects keys of the entry tree leaf level, posting trees are measured
+ * after the entry page is released
+ */
+static IndexKeyEntry *
+index_keys_collect(Relation index, int *nentries)
+{
+	GinState	ginstate;
+	IndexKeyEntry *entries;
+	int			maxentries = 1024;
+	BlockNumber blkno = GIN_ROOT_BLKNO;
+	Buffer		buffer;
+	Page		page;
+	int			i;
+
+	initGinState(&ginstate, index);
+	entries = (IndexKeyEntry *) palloc(maxentries * sizeof(IndexKeyEntry));
+	*nentries = 0;
+
+	for (;;)
+	{
+		IndexTuple	itup;
+
+		CHECK_FOR_INTERRUPTS();
+		buffer = ReadBuffer(index, blkno);
+		LockBuffer(buffer, GIN_SHARE);
+		page = GinBufferGetPage(buffer);
+		if (GinPageIsLeaf(page))
+			break;
+		itup = (IndexTuple) PageGetItem(page,
+										PageGetItemId(page, FirstOffsetNumber));
+		blkno = GinGetDownlink(itup);
+		UnlockReleaseBuffer(buffer);
+	}
+
+	for (;;)
+	{
+		OffsetNumber maxoff = PageGetMaxOffsetNumber(page);
+		OffsetNumber off;
+
+		for (off = FirstOffsetNumber; off <= maxoff; off++)
+		{
+			IndexTuple	itup = (IndexTuple) PageGetItem(page,
+														PageGetItemId(page, off));
+			GinNullCategory category;
+			Datum		key = gintuple_get_key(&ginstate, itup, &category);
+			IndexKeyEntry *entry;
+
+			if (category != GIN_CAT_NORM_KEY)
+				continue;
+			if (*nentries == maxentries)
+			{
+				maxentries *= 2;
+				entries = (IndexKeyEntry *) repalloc(entries,
+													 maxentries * sizeof(IndexKeyEntry));
+			}
+			entry = &entries[(*nentries)++];
+			entry->key = (uint32) DatumGetInt32(key);
+			entry->pages = 0;
+			if (GinIsPostingTree(itup))
+			{
+				entry->postings = 0;
+				entry->root = GinGetPostingTree(itup);
+			}
+			else
+			{
+				entry->postings = GinGetNPosting(itup);
+				entry->root = InvalidBlockNumber;
+			}
+		}
+
+		blkno = GinPageGetOpaque(page)->rightlink;
+		UnlockReleaseBuffer(buffer);
+		if (blkno == InvalidBlockNumber)
+			break;
+
+		CHECK_FOR_INTERRUPTS();
+		buffer = ReadBuffer(index, blkno);
+		LockBuffer(buffer, GIN_SHARE);
+		page = GinBufferGetPage(buffer);
+	}
+
+	for (i = 0; i < *nentries; i++)
+		if (entries[i].root != InvalidBlockNumber)
+			posting_tree_size(index, &entries[i]);
+
+	return entries;
+}
+#endif
+
+/*
+ * Walks a parray_gin index and returns its keys with most heap pointers,
+ * all keys if top is not positive:
+ * (key, kind, trigram, postings, pages)
+ * Rows in the pending list (fastupdate) are not counted.
+ */
+Datum
+parray_gin_index_keys(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 90400
+	typedef struct
+	{
+		IndexKeyEntry *entries;
+		int			nentries;
+	} IndexKeysState;
+
+	FuncCallContext *funcctx;
+	IndexKeysState *state;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		Oid			indexoid = PG_GETARG_OID(0);
+		int32		top = PG_GETARG_INT32(1);
+		Relation	index;
+		TupleDesc	tupdesc;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		index = index_open(indexoid, AccessShareLock);
+		if (index->rd_rel->relam != GIN_AM_OID ||
+			RelationGetDescr(index)->natts != 1 ||
+			TupleDescAttr(RelationGetDescr(index), 0)->atttypid != INT4OID)
+			ereport(ERROR,
+					(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+					 errmsg("\"%s\" is not a single column GIN index with int4 keys",
+							RelationGetRelationName(index))));
+
+		state = (IndexKeysState *) palloc(sizeof(IndexKeysState));
+		state->entries = index_keys_collect(index, &state->nentries);
+		index_close(index, AccessShareLock);
+
+		qsort(state->entries, state->nentries, sizeof(IndexKeyEntry),
+			  index_key_cmp);
+		if (top > 0 && top < state->nentries)
+			state->nentries = top;
+		funcctx->user_fctx = state;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (IndexKeysState *) funcctx->user_fctx;
+
+	if (funcctx->call_cntr < (uint64) state->nentries)
+	{
+		IndexKeyEntry *entry = &state->entries[funcctx->call_cntr];
+		const char *kind;
+		text	   *trigram = key_decode(entry->key, &kind);
+		Datum		values[5];
+		bool		isnull[5] = {false, false, false, false, false};
+
+		values[0] = Int32GetDatum((int32) entry->key);
+		values[1] = CStringGetTextDatum(kind);
+		values[2] = PointerGetDatum(trigram);
+		isnull[2] = trigram == NULL;
+		values[3] = Int64GetDatum(entry->postings);
+		values[4] = Int32GetDatum(entry->pages);
+
+		SRF_RETURN_NEXT(funcctx,
+						HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc,
+														  values, isnull)));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+#else
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("index walk requires PostgreSQL 9.4")));
+	PG_RETURN_NULL();
+#endif
+}
+
+/*
+ * Collision statistics for int4 keys of parray_gin_ops
+ */
+
+typedef struct
+{
+	uint64		trigram;		/* hash key, must be first */
+	int			nkeys;
+	uint32		keys[3 * MAX_MULTIBYTE_CHAR_LEN];
+} CollisionTrigram;
+
+typedef struct
+{
+	uint32		key;			/* hash key, must be first */
+	int64		ntrigrams;
+} CollisionKey;
+
+typedef struct
+{
+	HTAB	   *trigrams;
+	HTAB	   *keys;
+} CollisionState;
+
+static void
+add_collision_trgm(uint64 trigram, const char *str, int bytelen, void *arg)
+{
+	CollisionState *state = (CollisionState *) arg;
+	CollisionTrigram *entry;
+	CollisionKey *keyEntry;
+	trgm		tbuf[3 * MAX_MULTIBYTE_CHAR_LEN];
+	trgm	   *tptr;
+	bool		found;
+	int			i,
+				j;
+
+	entry = (CollisionTrigram *) hash_search(state->trigrams, &trigram,
+											 HASH_ENTER, &found);
+	if (found)
+		return;
+
+	/* int4 keys which parray_gin_ops makes of the very same characters */
+	tptr = make_trigrams(tbuf, (char *) str, bytelen,
+						 pg_mbstrlen_with_len(str, bytelen));
+	entry->nkeys = 0;
+	for (i = 0; i < tptr - tbuf; i++)
+	{
+		uint32		key = trgm2int(&tbuf[i]);
+
+		for (j = 0; j < entry->nkeys; j++)
+			if (entry->keys[j] == key)
+				break;
+		if (j < entry->nkeys)
+			continue;
+		entry->keys[entry->nkeys++] = key;
+
+		keyEntry = (CollisionKey *) hash_search(state->keys, &key,
+												HASH_ENTER, &found);
+		if (!found)
+			keyEntry->ntrigrams = 0;
+		keyEntry->ntrigrams++;
+	}
+}
+
+/*
+ * Counts distinct trigrams of the items and distinct int4 keys they give.
+ * A trigram collides if each of its int4 keys is shared with another
+ * trigram, collision_rate is a fraction of such trigrams.
+ */
+Datum
+parray_gin_collisions(PG_FUNCTION_ARGS)
+{
+	ArrayType  *items = PG_GETARG_ARRAYTYPE_P(0);
+	Datum	   *elems;
+	bool	   *nulls;
+	int			nelems;
+	HASHCTL		ctl;
+	CollisionState state;
+	HASH_SEQ_STATUS status;
+	CollisionTrigram *entry;
+	CollisionKey *keyEntry;
+	int64		ntrigrams = 0,
+				ncolliding = 0;
+	TupleDesc	tupdesc;
+	Datum		values[3];
+	bool		isnull[3] = {false, false, false};
+	int			i;
 
-		if (!itemNullFlags[indexKey])
-		{
-			pstr = TextDatumGetCString(itemKeys[indexKey]);
-			if (useWildcards)
-				trg = generate_wildcard_trgm(pstr, strlen(pstr));
-			else
-				trg = generate_trgm(pstr, strlen(pstr));
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
 
-			if (lengthsTrigrams)
-				(*lengthsTrigrams)[indexKey + 1] =
-					(Pointer) palloc_int32(ARRNELEM(trg));
+	deconstruct_array(items, ARR_ELEMTYPE(items), -1, false, 'i',
+					  &elems, &nulls, &nelems);
 
-			ptr = GETARR(trg);
-			for (i = 0; i < ARRNELEM(trg); i++)
-			{
-				/* grow on need */
-				if (*countTrigrams >= (int32)countArrTrigram)
-				{
-					countArrTrigram = (size_t) (1.4 * countArrTrigram);
-					keys = repalloc(keys, countArrTrigram);
-				}
-				item = trgm2int(ptr++);
-				keys[*countTrigrams] = Int32GetDatum(item);
-				(*countTrigrams)++;
-			}
-		}
-	}
-#if TRACE_LIKE_HELL
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint64);
+	ctl.entrysize = sizeof(CollisionTrigram);
+	ctl.hcxt = CurrentMemoryContext;
+#if PG_VERSION_NUM < 90500
+	ctl.hash = tag_hash;
+#endif
+	state.trigrams = hash_create("parray_gin collision trigrams", 1024, &ctl,
+								 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(CollisionKey);
+	state.keys = hash_create("parray_gin collision keys", 1024, &ctl,
+							 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	for (i = 0; i < nelems; i++)
+		if (!nulls[i])
+			walk_wide_trgm(VARDATA_ANY(DatumGetPointer(elems[i])),
+						   VARSIZE_ANY_EXHDR(DatumGetPointer(elems[i])),
+						   false, add_collision_trgm, &state);
+
+	hash_seq_init(&status, state.trigrams);
+	while ((entry = (CollisionTrigram *) hash_seq_search(&status)) != NULL)
 	{
-		text	   *tstr;
+		bool		colliding = entry->nkeys > 0;
 
-		tstr = DatumGetTextP(OidFunctionCall3Coll(OID_ARRAY_TO_TEXT_NULL,
-												  PG_GET_COLLATION(),
-												  PointerGetDatum(items),
-												  CStringGetTextDatum("#"),
-												  CStringGetTextDatum("NULL")
-												  ));
-
-		elog(PARRAY_GIN_TRACE,
-			 "GIN trigrams_from_textarray: %d items, %s, %d trigrams",
-			 countItemKeys, TextDatumGetCString(tstr), *countTrigrams);
-		for (indexKey = 0; indexKey < countItemKeys; ++indexKey)
-		{
-			elog(PARRAY_GIN_TRACE,
-				 "  trigrams_from_textarray item %d = %s (%d)", indexKey,
-				 itemNullFlags[indexKey]
-				 ? "NULL"
-				 : (const char *) TextDatumGetCString(itemKeys[indexKey]),
-				 (lengthsTrigrams
-				  ? *((int32 *) (*lengthsTrigrams)[indexKey + 1])
-				  : -1));
-		}
-		for (i = 0; i < *countTrigrams; ++i)
+		for (i = 0; i < entry->nkeys; i++)
 		{
-			uint32		key = (uint32) DatumGetInt32(keys[i]);
-
-			elog(PARRAY_GIN_TRACE,
-				 "  trigrams_from_textarray item trgm = %x (%c%c%c)", key,
-				 ((unsigned char *) &key)[2],
-				 ((unsigned char *) &key)[1],
-				 ((unsigned char *) &key)[0]
-				);
+			keyEntry = (CollisionKey *) hash_search(state.keys,
+													&entry->keys[i],
+													HASH_FIND, NULL);
+			if (keyEntry->ntrigrams < 2)
+				colliding = false;
 		}
+		ntrigrams++;
+		if (colliding)
+			ncolliding++;
 	}
-#endif
 
-	PG_RETURN_POINTER(keys);
+	values[0] = Int64GetDatum(ntrigrams);
+	values[1] = Int64GetDatum((int64) hash_get_num_entries(state.keys));
+	values[2] = Float8GetDatum(ntrigrams > 0
+							   ? (double) ncolliding / ntrigrams : 0.0);
+
+	hash_destroy(state.trigrams);
+	hash_destroy(state.keys);
+	pfree(elems);
+	pfree(nulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc),
+													  values, isnull)));
 }
 
 /**
@@ -584,36 +2740,41 @@ trigrams_from_textarray(PG_FUNCTION_ARGS)
 
 /*
  * Compare two keys
- * Strict compare
+ * Strict compare, same order as btint4cmp. Called a lot during index
+ * build, so avoid a nested function call.
  */
 Datum
 parray_gin_compare(PG_FUNCTION_ARGS)
 {
-	Datum		datum1 = PG_GETARG_DATUM(0);
-	Datum		datum2 = PG_GETARG_DATUM(1);
+	int32		key1 = PG_GETARG_INT32(0);
+	int32		key2 = PG_GETARG_INT32(1);
 
-	int32		result = DatumGetInt32(DirectFunctionCall2Coll(btint4cmp,
-										PG_GET_COLLATION(),
-										datum1, datum2));
+	PG_RETURN_INT32(key1 < key2 ? -1 : (key1 > key2 ? 1 : 0));
+}
 
-#if TRACE_LIKE_HELL
-/*	elog(PARRAY_GIN_TRACE, "GIN compare: %d vs %d -> %d",
-		 key1, key2, result);*/
-#endif
+/*
+ * Compare two wide keys
+ */
+Datum
+parray_gin_wide_compare(PG_FUNCTION_ARGS)
+{
+	int64		key1 = PG_GETARG_INT64(0);
+	int64		key2 = PG_GETARG_INT64(1);
 
-	PG_RETURN_INT32(result);
+	PG_RETURN_INT32(key1 < key2 ? -1 : (key1 > key2 ? 1 : 0));
 }
 
 /*
  * Extract keys from indexed item
  * Keys are text, item is an array text[]
  * (Datum itemValue, int32 *nkeys, bool **nullFlags) */
-Datum
-parray_gin_extract_value(PG_FUNCTION_ARGS)
+static Datum
+gin_extract_value(FunctionCallInfo fcinfo, bool wide)
 {
-	ArrayType  *itemValue = PG_GETARG_ARRAYTYPE_P_COPY(0);
+	ArrayType  *itemValue = PG_GETARG_ARRAYTYPE_P(0);
 	int32	   *nkeys = (int32 *) PG_GETARG_POINTER(1);
 	bool	  **nullFlags = (bool **) PG_GETARG_POINTER(2);
+	ParrayGinOptions options;
 
 	/*
 	 * Result type, contains int32 datums with all trigrams for all indexed
@@ -621,20 +2782,99 @@ parray_gin_extract_value(PG_FUNCTION_ARGS)
 	 */
 	Datum	   *keys;
 
-#if TRACE_LIKE_HELL
-	elog(PARRAY_GIN_TRACE, "GIN extract_value invoked");
-#endif
 
-	keys = (Datum *) DirectFunctionCall4Coll(trigrams_from_textarray,
-											 PG_GET_COLLATION(),
-											 PointerGetDatum(itemValue),
-											 PointerGetDatum(nkeys),
-											 BoolGetDatum(false),
-											 PointerGetDatum(NULL));
+	get_gin_options(fcinfo, &options);
+	keys = trigrams_from_textarray(itemValue, PG_GET_COLLATION(), &options,
+								   wide, false, false, nkeys, NULL);
+
+	*nullFlags = NULL;
+	stats_add(STATS_VALUES, 1);
+	stats_add(STATS_VALUE_KEYS, *nkeys);
+	if (trace_level != 0 && trace_sampled())
+		elog(trace_level, "parray_gin extract_value: items=%d keys=%d",
+			 ArrayGetNItems(ARR_NDIM(itemValue), ARR_DIMS(itemValue)),
+			 *nkeys);
+
+	PG_RETURN_POINTER(keys);
+}
+
+Datum
+parray_gin_extract_value(PG_FUNCTION_ARGS)
+{
+	return gin_extract_value(fcinfo, false);
+}
+
+Datum
+parray_gin_wide_extract_value(PG_FUNCTION_ARGS)
+{
+	return gin_extract_value(fcinfo, true);
+}
+
+/*
+ * Extract keys from indexed jsonb, string items of a top-level array
+ * (Datum itemValue, int32 *nkeys, bool **nullFlags) */
+Datum
+parray_gin_jsonb_extract_value(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 90400
+	Jsonb	   *itemValue = PG_GETARG_JSONB_P(0);
+	int32	   *nkeys = (int32 *) PG_GETARG_POINTER(1);
+	bool	  **nullFlags = (bool **) PG_GETARG_POINTER(2);
+	ParrayGinOptions options;
+	char	  **itemStrs;
+	int		   *itemLens;
+	int			nitems;
+	Datum	   *keys;
+
+	get_gin_options(fcinfo, &options);
+	nitems = jsonb_string_items(itemValue, &itemStrs, &itemLens);
+	keys = trigrams_from_items(itemStrs, itemLens, nitems, &options,
+							   false, false, false, nkeys, NULL);
+	pfree(itemStrs);
+	pfree(itemLens);
 
 	*nullFlags = NULL;
+	stats_add(STATS_VALUES, 1);
+	stats_add(STATS_VALUE_KEYS, *nkeys);
+	if (trace_level != 0 && trace_sampled())
+		elog(trace_level, "parray_gin extract_value: items=%d keys=%d",
+			 nitems, *nkeys);
 
 	PG_RETURN_POINTER(keys);
+#else
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("jsonb requires PostgreSQL 9.4")));
+	PG_RETURN_POINTER(NULL);
+#endif
+}
+
+/*
+ * Attach the query description to every key. A query without keys gets
+ * TRUNCATED_KEY alone, which consistent ignores, so that its scan still
+ * reaches consistent with the description.
+ */
+static void
+query_info_finish(ParrayGinQuery *queryInfo, Datum **keys, int32 *nkeys,
+				  Pointer **extra_data, int32 searchMode, bool wide)
+{
+	int			i;
+
+	queryInfo->nkeys = *nkeys - (queryInfo->truncatedKey ? 1 : 0);
+	queryInfo->fullScan = searchMode == GIN_SEARCH_MODE_ALL;
+
+	if (*nkeys == 0)
+	{
+		*keys = (Datum *) palloc(sizeof(Datum));
+		(*keys)[(*nkeys)++] = wide
+			? Int64GetDatum(WIDE_SHORTKEY_FLAG | TRUNCATED_KEY)
+			: Int32GetDatum(TRUNCATED_KEY);
+		queryInfo->truncatedKey = true;
+	}
+
+	*extra_data = (Pointer *) palloc(*nkeys * sizeof(Pointer));
+	for (i = 0; i < *nkeys; ++i)
+		(*extra_data)[i] = (Pointer) queryInfo;
 }
 
 /*
@@ -643,10 +2883,10 @@ parray_gin_extract_value(PG_FUNCTION_ARGS)
  *	 Datum query, int32 *nkeys, StrategyNumber n, bool **pmatch,
  *	 Pointer **extra_data, bool **nullFlags, int32 *searchMode)
  */
-Datum
-parray_gin_extract_query(PG_FUNCTION_ARGS)
+static Datum
+gin_extract_query(FunctionCallInfo fcinfo, bool wide)
 {
-	Datum		query = PG_GETARG_DATUM(0);
+	ArrayType  *query = PG_GETARG_ARRAYTYPE_P(0);
 	int32	   *nkeys = (int32 *) PG_GETARG_POINTER(1);
 	StrategyNumber strategy = PG_GETARG_UINT16(2);
 	bool	  **pmatch = (bool **) PG_GETARG_POINTER(3);
@@ -654,37 +2894,203 @@ parray_gin_extract_query(PG_FUNCTION_ARGS)
 	bool	  **nullFlags = (bool **) PG_GETARG_POINTER(5);
 	int32     *searchMode = (int32 *) PG_GETARG_POINTER(6);
 
+	ParrayGinOptions options;
+	ParrayGinQuery *queryInfo;
 	Datum	   *keys;
 	bool		is_partial;
+	bool		is_contained;
+	bool		is_unaccent;
+	int32	   *itemKeys;
+	int			i;
 
-#if TRACE_LIKE_HELL
-	elog(PARRAY_GIN_TRACE, "GIN extract_query invoked");
-#endif
 
-	if (!is_valid_strategy(strategy))
+	if (!is_valid_strategy(strategy) ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINS_WORDS)
 	{
 		ereport(ERROR, (errcode(ERRCODE_INVALID_NAME),
 						errmsg("wrong strategy %d", strategy)));
 	}
+	is_unaccent = strategy == PARRAY_GIN_STRATEGY_CONTAINS_UNACCENT ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY_UNACCENT;
 	is_partial = strategy == PARRAY_GIN_STRATEGY_CONTAINS_PARTIAL ||
-		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY_PARTIAL;
+		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY_PARTIAL || is_unaccent;
+	is_contained = strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY_PARTIAL ||
+		strategy == PARRAY_GIN_STRATEGY_CONTAINED_BY_UNACCENT;
 
 	/* query is an array of texts, parse it and return trigrams */
-	keys = (Datum *) DirectFunctionCall4Coll(trigrams_from_textarray,
-											 PG_GET_COLLATION(),
-											 query,
-											 PointerGetDatum(nkeys),
-											 BoolGetDatum(is_partial),
-											 PointerGetDatum(extra_data));
+	get_gin_options(fcinfo, &options);
+	keys = trigrams_from_textarray(query, PG_GET_COLLATION(), &options,
+								   wide, true, is_partial, nkeys, &itemKeys);
 	*nullFlags = NULL;
 	*pmatch = NULL;
 
+	/*
+	 * Keys of accented items match unaccented patterns only if the index
+	 * is unaccented, scan all the index otherwise
+	 */
+	if (is_unaccent && !options.unaccent)
+		*nkeys = 0;
+
+	queryInfo = (ParrayGinQuery *) palloc0(sizeof(ParrayGinQuery));
+	queryInfo->nitems = ArrayGetNItems(ARR_NDIM(query), ARR_DIMS(query));
+	queryInfo->itemKeys = itemKeys;
+
+	if (is_contained)
+	{
+		/*
+		 * Any indexed item can match an query item without keys, so scan
+		 * all the index then. Otherwise empty items match too.
+		 */
+		*searchMode = GIN_SEARCH_MODE_INCLUDE_EMPTY;
+		for (i = 0; i < queryInfo->nitems; ++i)
+			if (itemKeys[i] == 0)
+				*searchMode = GIN_SEARCH_MODE_ALL;
+	}
+
 	/*
 	 * If no trigram was extracted then we have to scan all the index.
 	 */
 	if (*nkeys == 0)
 		*searchMode = GIN_SEARCH_MODE_ALL;
 
+	/*
+	 * Values with truncated items may lack some of the query keys, fetch
+	 * them for recheck too
+	 */
+	if (options.max_element_bytes > 0 && *searchMode != GIN_SEARCH_MODE_ALL)
+	{
+		keys = (Datum *) repalloc(keys, (*nkeys + 1) * sizeof(Datum));
+		keys[(*nkeys)++] = wide
+			? Int64GetDatum(WIDE_SHORTKEY_FLAG | TRUNCATED_KEY)
+			: Int32GetDatum(TRUNCATED_KEY);
+		queryInfo->truncatedKey = true;
+	}
+
+	query_info_finish(queryInfo, &keys, nkeys, extra_data, *searchMode,
+					  wide);
+
+	if (trace_level != 0 && trace_sampled())
+	{
+		StringInfoData buf;
+
+		initStringInfo(&buf);
+		trace_keys(&buf, keys, queryInfo->nkeys, wide);
+		elog(trace_level, "parray_gin extract_query: strategy=%d items=%d "
+			 "keys=%d mode=%s %s", (int) strategy, queryInfo->nitems,
+			 queryInfo->nkeys,
+			 *searchMode == GIN_SEARCH_MODE_ALL ? "all" :
+			 (*searchMode == GIN_SEARCH_MODE_INCLUDE_EMPTY ? "include_empty"
+			  : "default"), buf.data);
+		pfree(buf.data);
+
+		/*
+		 * Scan summary, the scan frees queryInfo when it ends. The planner
+		 * extracts queries too, so the report is armed by the first
+		 * consistent call only.
+		 */
+		queryInfo->trace = (ScanTrace *) palloc0(sizeof(ScanTrace));
+		queryInfo->trace->level = trace_level;
+		queryInfo->trace->strategy = strategy;
+		queryInfo->trace->nkeys = queryInfo->nkeys;
+#if PG_VERSION_NUM >= 90500
+		queryInfo->trace->context = CurrentMemoryContext;
+		queryInfo->trace->callback.func = trace_scan_report;
+		queryInfo->trace->callback.arg = queryInfo->trace;
+#endif
+	}
+
+	PG_RETURN_POINTER(keys);
+}
+
+Datum
+parray_gin_extract_query(PG_FUNCTION_ARGS)
+{
+	return gin_extract_query(fcinfo, false);
+}
+
+Datum
+parray_gin_wide_extract_query(PG_FUNCTION_ARGS)
+{
+	return gin_extract_query(fcinfo, true);
+}
+
+/*
+ * Extract word keys from indexed value
+ * (Datum itemValue, int32 *nkeys, bool **nullFlags) */
+Datum
+parray_gin_word_extract_value(PG_FUNCTION_ARGS)
+{
+	ArrayType  *itemValue = PG_GETARG_ARRAYTYPE_P(0);
+	int32	   *nkeys = (int32 *) PG_GETARG_POINTER(1);
+	bool	  **nullFlags = (bool **) PG_GETARG_POINTER(2);
+	Datum	   *keys;
+
+	keys = words_from_textarray(itemValue, nkeys);
+
+	*nullFlags = NULL;
+	stats_add(STATS_VALUES, 1);
+	stats_add(STATS_VALUE_KEYS, *nkeys);
+	if (trace_level != 0 && trace_sampled())
+		elog(trace_level, "parray_gin extract_value: items=%d keys=%d",
+			 ArrayGetNItems(ARR_NDIM(itemValue), ARR_DIMS(itemValue)),
+			 *nkeys);
+
+	PG_RETURN_POINTER(keys);
+}
+
+/*
+ * Parse query (rhs) to the word keys, an indexed value must have all of
+ * them. Items have no patterns, extra data only describes the query.
+ *	 Datum query, int32 *nkeys, StrategyNumber n, bool **pmatch,
+ *	 Pointer **extra_data, bool **nullFlags, int32 *searchMode)
+ */
+Datum
+parray_gin_word_extract_query(PG_FUNCTION_ARGS)
+{
+	ArrayType  *query = PG_GETARG_ARRAYTYPE_P(0);
+	int32	   *nkeys = (int32 *) PG_GETARG_POINTER(1);
+	StrategyNumber strategy = PG_GETARG_UINT16(2);
+	bool	  **pmatch = (bool **) PG_GETARG_POINTER(3);
+	bool	  **nullFlags = (bool **) PG_GETARG_POINTER(5);
+	Pointer   **extra_data = (Pointer **) PG_GETARG_POINTER(4);
+	int32	   *searchMode = (int32 *) PG_GETARG_POINTER(6);
+	Datum	   *keys;
+	ParrayGinQuery *queryInfo;
+
+	if (strategy != PARRAY_GIN_STRATEGY_CONTAINS_WORDS)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_NAME),
+						errmsg("wrong strategy %d", strategy)));
+	}
+
+	keys = words_from_textarray(query, nkeys);
+	*nullFlags = NULL;
+	*pmatch = NULL;
+
+	/* without words everything matches */
+	if (*nkeys == 0)
+		*searchMode = GIN_SEARCH_MODE_ALL;
+
+	queryInfo = (ParrayGinQuery *) palloc0(sizeof(ParrayGinQuery));
+	queryInfo->nitems = ArrayGetNItems(ARR_NDIM(query), ARR_DIMS(query));
+	query_info_finish(queryInfo, &keys, nkeys, extra_data, *searchMode,
+					  false);
+
+	if (trace_level != 0 && trace_sampled())
+	{
+		StringInfoData buf;
+
+		initStringInfo(&buf);
+		trace_keys(&buf, keys, queryInfo->nkeys, false);
+		elog(trace_level, "parray_gin extract_query: strategy=%d items=%d "
+			 "keys=%d mode=%s %s", (int) strategy, queryInfo->nitems,
+			 queryInfo->nkeys,
+			 *searchMode == GIN_SEARCH_MODE_ALL ? "all" : "default",
+			 buf.data);
+		pfree(buf.data);
+	}
+
 	PG_RETURN_POINTER(keys);
 }
 
@@ -707,6 +3113,7 @@ parray_gin_consistent(PG_FUNCTION_ARGS)
 	Pointer    *extra_data = (Pointer *) PG_GETARG_POINTER(4);
 	bool	   *recheck = (bool *) PG_GETARG_POINTER(5);
 
+	ParrayGinQuery *queryInfo = NULL;
 	bool		result = false;
 	int			i;
 
@@ -717,8 +3124,39 @@ parray_gin_consistent(PG_FUNCTION_ARGS)
 	}
 	*recheck = true;
 
-	if (strategy == PARRAY_GIN_STRATEGY_CONTAINS ||
-		strategy == PARRAY_GIN_STRATEGY_CONTAINS_PARTIAL)
+	if (nkeys > 0 && extra_data)
+	{
+		queryInfo = (ParrayGinQuery *) extra_data[0];
+		if (queryInfo->truncatedKey)
+			nkeys--;
+	}
+
+	/*
+	 * Planner extracts queries too, so statistics count a query when its
+	 * scan checks a value
+	 */
+	if (queryInfo && !queryInfo->counted)
+	{
+		queryInfo->counted = true;
+		stats_add(STATS_QUERIES, 1);
+		stats_add(STATS_QUERY_KEYS, queryInfo->nkeys);
+		stats_add(STATS_FULL_SCANS, queryInfo->fullScan ? 1 : 0);
+	}
+
+	if (queryInfo && queryInfo->truncatedKey && check[nkeys])
+	{
+		/* indexed value has truncated items, only recheck can tell */
+		result = true;
+	}
+	else if (nkeys == 0)
+	{
+		/* full index scan, recheck decides */
+		result = true;
+	}
+	else if (strategy == PARRAY_GIN_STRATEGY_CONTAINS ||
+			 strategy == PARRAY_GIN_STRATEGY_CONTAINS_PARTIAL ||
+			 strategy == PARRAY_GIN_STRATEGY_CONTAINS_WORDS ||
+			 strategy == PARRAY_GIN_STRATEGY_CONTAINS_UNACCENT)
 	{
 		/* all */
 		result = true;
@@ -728,8 +3166,7 @@ parray_gin_consistent(PG_FUNCTION_ARGS)
 	}
 	else
 	{
-		int32	  **positions = (int32 **) extra_data;
-		int			extent,
+		int			item,
 					prev = 0;
 
 		/*
@@ -739,35 +3176,298 @@ parray_gin_consistent(PG_FUNCTION_ARGS)
 		 *
 		 * Check each extent described by extra_data (= each query element)
 		 */
-		if (!extra_data)
+		if (!queryInfo)
 			ereport(ERROR, (errcode(ERRCODE_INVALID_NAME),
 					   errmsg("not enough data for strategy %d", strategy)));
-		for (extent = 0; extent < *(positions[0]) - 1; ++extent)
+		for (item = 0; item < queryInfo->nitems; ++item)
 		{
 			result = true;
-			for (i = prev; i < prev + *(positions[extent + 1]); ++i)
+			for (i = prev; i < prev + queryInfo->itemKeys[item]; ++i)
 				if (!check[i])
 					result = false;
 			if (result)
 				break;
-			prev += *(positions[extent]);
+			prev += queryInfo->itemKeys[item];
+		}
+
+		/* an empty indexed item has no keys at all but is contained */
+		if (!result)
+		{
+			result = true;
+			for (i = 0; i < nkeys; ++i)
+				if (check[i])
+					result = false;
+		}
+	}
+
+
+	stats_add(STATS_CONSISTENT, 1);
+	stats_add(STATS_CANDIDATES, result ? 1 : 0);
+	if (queryInfo && queryInfo->trace)
+	{
+#if PG_VERSION_NUM >= 90500
+		if (queryInfo->trace->consistent == 0)
+			MemoryContextRegisterResetCallback(queryInfo->trace->context,
+											   &queryInfo->trace->callback);
+#endif
+		queryInfo->trace->consistent++;
+		queryInfo->trace->candidates += result ? 1 : 0;
+	}
+
+	PG_RETURN_BOOL(result);
+}
+
+/**
+ *
+ * Planner support
+ *
+ */
+
+#if PG_VERSION_NUM >= 120000
+
+/* guesses for recheck cost when arguments are unknown */
+#define SUPPORT_DEFAULT_PATTERNS 4
+#define SUPPORT_DEFAULT_WIDTH 64
+
+/* operator functions and their operators, partial ones go last */
+static const char *const support_names[][2] = {
+	{"parray_contains_strict", "@>"},
+	{"parray_contained_strict", "<@"},
+	{"parray_contains_partial", "@@>"},
+	{"parray_contained_partial", "<@@"}
+};
+
+/*
+ * Index in support_names of an operator function, -1 for other functions
+ */
+static int
+support_function_kind(Oid funcid)
+{
+	char	   *funcname = get_func_name(funcid);
+	int			i;
+
+	if (funcname)
+		for (i = 0; i < lengthof(support_names); i++)
+			if (strcmp(funcname, support_names[i][0]) == 0)
+				return i;
+	return -1;
+}
+
+/*
+ * Operator implemented by an operator function, looked up by the name of
+ * the function in its schema. Returns InvalidOid for other functions.
+ */
+static Oid
+support_operator(Oid funcid, Oid lefttype, Oid righttype)
+{
+	int			kind = support_function_kind(funcid);
+	char	   *nspname;
+
+	if (kind < 0)
+		return InvalidOid;
+
+	nspname = get_namespace_name(get_func_namespace(funcid));
+	if (!nspname)
+		return InvalidOid;
+
+	return OpernameGetOprid(list_make2(makeString(nspname),
+									   makeString(pstrdup(support_names[kind][1]))),
+							lefttype, righttype);
+}
+
+/*
+ * Average width of a column, for a recheck cost
+ */
+static int32
+support_width(PlannerInfo *root, Node *node)
+{
+	Var		   *var;
+	RangeTblEntry *rte;
+	int32		width = 0;
+
+	if (root && node && IsA(node, Var))
+	{
+		var = (Var *) node;
+		if (var->varlevelsup == 0 && var->varno > 0 &&
+			var->varno < root->simple_rel_array_size)
+		{
+			rte = planner_rt_fetch(var->varno, root);
+			if (rte->rtekind == RTE_RELATION)
+				width = get_attavgwidth(rte->relid, var->varattno);
 		}
 	}
 
-#if TRACE_LIKE_HELL
+	return width > 0 ? width : SUPPORT_DEFAULT_WIDTH;
+}
+
+/*
+ * Number of items of a constant pattern array
+ */
+static int
+support_patterns(Node *node)
+{
+	Const	   *c;
+	ArrayType  *array;
+
+	if (node && IsA(node, Const) && !((Const *) node)->constisnull &&
+		type_is_array(((Const *) node)->consttype))
+	{
+		c = (Const *) node;
+		array = DatumGetArrayTypeP(c->constvalue);
+		return Max(ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array)), 1);
+	}
+
+	return SUPPORT_DEFAULT_PATTERNS;
+}
+#endif
+
+/*
+ * Planner support function of operator functions
+ *	Node *request
+ *
+ * Function calls like parray_contains_partial(val, array['x%']) become
+ * index conditions, their selectivity is the one of the operator and
+ * cost grows with the array width and the number of patterns.
+ */
+Datum
+parray_support(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 120000
+	Node	   *rawreq = (Node *) PG_GETARG_POINTER(0);
+	Node	   *ret = NULL;
+
+	if (IsA(rawreq, SupportRequestIndexCondition))
+	{
+		SupportRequestIndexCondition *req =
+			(SupportRequestIndexCondition *) rawreq;
+
+		if (is_funcclause(req->node) && req->indexarg == 0)
+		{
+			FuncExpr   *clause = (FuncExpr *) req->node;
+			Node	   *leftop;
+			Node	   *rightop;
+			Oid			opno;
+
+			if (list_length(clause->args) != 2)
+				PG_RETURN_POINTER(NULL);
+			leftop = (Node *) linitial(clause->args);
+			rightop = (Node *) lsecond(clause->args);
+
+			opno = support_operator(clause->funcid, exprType(leftop),
+									exprType(rightop));
+			if (OidIsValid(opno) && op_in_opfamily(opno, req->opfamily) &&
+				is_pseudo_constant_for_index(req->root, rightop, req->index))
+			{
+				req->lossy = false;
+				ret = (Node *) list_make1(make_opclause(opno, BOOLOID, false,
+														(Expr *) leftop,
+														(Expr *) rightop,
+														InvalidOid,
+														clause->inputcollid));
+			}
+		}
+	}
+	else if (IsA(rawreq, SupportRequestSelectivity))
+	{
+		SupportRequestSelectivity *req = (SupportRequestSelectivity *) rawreq;
+		Oid			opno = InvalidOid;
+
+		if (list_length(req->args) == 2)
+			opno = support_operator(req->funcid,
+									exprType(linitial(req->args)),
+									exprType(lsecond(req->args)));
+		if (OidIsValid(opno))
+		{
+			if (req->is_join)
+				req->selectivity = join_selectivity(req->root, opno, req->args,
+													req->inputcollid,
+													req->jointype,
+													req->sjinfo);
+			else
+				req->selectivity = restriction_selectivity(req->root, opno,
+														   req->args,
+														   req->inputcollid,
+														   req->varRelid);
+			ret = (Node *) req;
+		}
+	}
+	else if (IsA(rawreq, SupportRequestCost))
 	{
-		ArrayType  *arrayCheck = construct_bool_array(check, nkeys);
+		SupportRequestCost *req = (SupportRequestCost *) rawreq;
+		int			kind = support_function_kind(req->funcid);
+		List	   *args = NIL;
+		Node	   *leftop = NULL;
+		Node	   *rightop = NULL;
+
+		if (req->node && IsA(req->node, FuncExpr))
+			args = ((FuncExpr *) req->node)->args;
+		else if (req->node && IsA(req->node, OpExpr))
+			args = ((OpExpr *) req->node)->args;
+		if (list_length(args) == 2)
+		{
+			leftop = (Node *) linitial(args);
+			rightop = (Node *) lsecond(args);
+		}
 
-		elog(PARRAY_GIN_TRACE, "GIN consistent: strategy=%d -> %s",
-			 (int) strategy, result ? "true" : "false");
-		DirectFunctionCall3Coll(dump_array, PG_GET_COLLATION(),
-								PointerGetDatum(arrayCheck),
-								CStringGetDatum("  check"),
-								CStringGetDatum(""));
+		if (kind >= 0)
+		{
+			/*
+			 * Every pattern is compared with every item: textlike walks
+			 * item bytes, texteq mostly stops at the length check.
+			 */
+			bool		partial = kind >= 2;
+			int32		width = support_width(req->root, leftop);
+			int			npatterns = support_patterns(rightop);
+
+			req->startup = 0;
+			req->per_tuple = cpu_operator_cost *
+				(1 + npatterns * Max(width / (partial ? 8 : 32), 1));
+			ret = (Node *) req;
+		}
 	}
+
+	PG_RETURN_POINTER(ret);
+#else
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("planner support functions require PostgreSQL 12")));
+	PG_RETURN_POINTER(NULL);
 #endif
+}
 
-	PG_RETURN_BOOL(result);
+/*
+ * Operator class options
+ *	local_relopts *relopts
+ */
+Datum
+parray_gin_options(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 130000
+	local_relopts *relopts = (local_relopts *) PG_GETARG_POINTER(0);
+
+	init_local_reloptions(relopts, sizeof(ParrayGinOptions));
+	add_local_bool_reloption(relopts, "short_keys",
+							 "index unigrams and bigrams for patterns "
+							 "without trigrams",
+							 false,
+							 offsetof(ParrayGinOptions, short_keys));
+	add_local_int_reloption(relopts, "max_element_bytes",
+							"index only this many leading bytes of an item, "
+							"0 for no limit",
+							0, 0, INT_MAX,
+							offsetof(ParrayGinOptions, max_element_bytes));
+	add_local_bool_reloption(relopts, "unaccent",
+							 "index items without diacritics for "
+							 "accent-insensitive operators",
+							 false,
+							 offsetof(ParrayGinOptions, unaccent));
+#else
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("operator class options require PostgreSQL 13")));
+#endif
+
+	PG_RETURN_VOID();
 }
 
 /* vim: set noexpandtab tabstop=4 shiftwidth=4 colorcolumn=80: */
@@ -0,0 +1,588 @@
+/*
+ * parray_trgm type
+ *
+ * Trigrams of every item of a text array, made once by parray_trgm(text[])
+ * and stored next to the array, e.g. in a generated column. Operators on
+ * it prefilter and rank rows without tokenizing items again; trigrams of
+ * the right side are made once per call site.
+ */
+#include "postgres.h"
+
+#include "trgm.h"
+
+#include "catalog/pg_type.h"
+#include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+
+/* memory context sizes macro appeared in postgres 9.6 */
+#if PG_VERSION_NUM < 90600
+#define ALLOCSET_DEFAULT_SIZES \
+	ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE
+#endif
+
+/* fixed-width send functions appeared in postgres 11 */
+#if PG_VERSION_NUM < 110000
+#define pq_sendint32(buf, i) pq_sendint(buf, i, 4)
+#endif
+
+/*
+ * Flat layout: nitems + 1 offsets into an array of trigram keys following
+ * them. Keys of item i are keys[offsets[i]] up to keys[offsets[i + 1]],
+ * trgm2int values sorted ascending, so the stored form does not depend on
+ * signedness of char. Null items have no keys.
+ */
+typedef struct
+{
+	int32		vl_len_;		/* varlena header (do not touch directly!) */
+	int32		nitems;
+	uint32		offsets[1];		/* nitems + 1 offsets, then keys */
+} ParrayTrgm;
+
+#define PARRAY_TRGM_SIZE(nitems, nkeys) \
+	(offsetof(ParrayTrgm, offsets) + ((nitems) + 1 + (nkeys)) * sizeof(uint32))
+#define PARRAY_TRGM_KEYS(pt)		((pt)->offsets + (pt)->nitems + 1)
+#define PARRAY_TRGM_ITEM(pt, i)		(PARRAY_TRGM_KEYS(pt) + (pt)->offsets[i])
+#define PARRAY_TRGM_NKEYS(pt, i) \
+	((int) ((pt)->offsets[(i) + 1] - (pt)->offsets[i]))
+
+#define PG_GETARG_PARRAY_TRGM_P(n) \
+	((ParrayTrgm *) PG_DETOAST_DATUM(PG_GETARG_DATUM(n)))
+
+/*
+ * Trigrams of the right argument of an operator, kept in fn_extra while
+ * the argument stays the same
+ */
+typedef struct
+{
+	MemoryContext context;		/* holds everything below, caller context
+								 * if there is no call site */
+	int32		len;			/* bytes of the argument */
+	char	   *bytes;
+	int			npatterns;
+	uint32	  **keys;			/* keys of each pattern, NULL if null */
+	int		   *nkeys;
+} PatternKeys;
+
+PG_FUNCTION_INFO_V1(parray_trgm_in);
+Datum		parray_trgm_in(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(parray_trgm_out);
+Datum		parray_trgm_out(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(parray_trgm_recv);
+Datum		parray_trgm_recv(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(parray_trgm_send);
+Datum		parray_trgm_send(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(parray_trgm);
+Datum		parray_trgm(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(parray_trgm_contains_partial);
+Datum		parray_trgm_contains_partial(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(parray_trgm_similarity);
+Datum		parray_trgm_similarity(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(parray_trgm_distance);
+Datum		parray_trgm_distance(PG_FUNCTION_ARGS);
+
+
+static int
+comp_key(const void *a, const void *b)
+{
+	uint32		ka = *(const uint32 *) a;
+	uint32		kb = *(const uint32 *) b;
+
+	return (ka > kb) ? 1 : ((ka < kb) ? -1 : 0);
+}
+
+/*
+ * Sort and unique keys of an item, returns the new number of keys
+ */
+static int
+sort_item_keys(uint32 *item, int n)
+{
+	int			i,
+				j = 0;
+
+	if (n <= 1)
+		return n;
+	qsort(item, n, sizeof(uint32), comp_key);
+	for (i = 1; i < n; i++)
+		if (item[i] != item[j])
+			item[++j] = item[i];
+	return j + 1;
+}
+
+/*
+ * Packed trigrams as trgm2int values sorted ascending. trgm_pack sorts
+ * them like CMPTRGM does, which depends on signedness of char.
+ */
+static int
+pack_item_keys(TRGM *trg, uint32 *keys)
+{
+	int			n = trgm_pack(trg, keys),
+				i;
+
+	if (TRGM_SORTKEY_FLIP != 0)
+	{
+		for (i = 0; i < n; i++)
+			keys[i] ^= TRGM_SORTKEY_FLIP;
+		qsort(keys, n, sizeof(uint32), comp_key);
+	}
+	return n;
+}
+
+static void
+skip_spaces(char **ptr)
+{
+	while (**ptr == ' ' || **ptr == '\t' || **ptr == '\n' || **ptr == '\r')
+		(*ptr)++;
+}
+
+static void
+parray_trgm_syntax_error(const char *str)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+			 errmsg("invalid input syntax for type parray_trgm: \"%s\"",
+					str)));
+}
+
+/*
+ * Text form is a list of items, an item is a list of trigrams as hex
+ * trgm2int values: {[202061 206162],[]}. Keys of an item may come in any
+ * order, they are sorted on input.
+ */
+Datum
+parray_trgm_in(PG_FUNCTION_ARGS)
+{
+	char	   *str = PG_GETARG_CSTRING(0);
+	char	   *ptr = str;
+	ParrayTrgm *result;
+	uint32	   *offsets,
+			   *keys;
+	int			nitems = 0,
+				nkeys = 0,
+				maxitems = 8,
+				maxkeys = 64;
+
+	offsets = (uint32 *) palloc(sizeof(uint32) * (maxitems + 1));
+	keys = (uint32 *) palloc(sizeof(uint32) * maxkeys);
+	offsets[0] = 0;
+
+	skip_spaces(&ptr);
+	if (*ptr++ != '{')
+		parray_trgm_syntax_error(str);
+	skip_spaces(&ptr);
+
+	while (*ptr != '}')
+	{
+		int			first = nkeys;
+
+		if (nitems > 0)
+		{
+			if (*ptr++ != ',')
+				parray_trgm_syntax_error(str);
+			skip_spaces(&ptr);
+		}
+		if (*ptr++ != '[')
+			parray_trgm_syntax_error(str);
+		skip_spaces(&ptr);
+
+		while (*ptr != ']')
+		{
+			char	   *end;
+			unsigned long key = strtoul(ptr, &end, 16);
+
+			if (end == ptr || key > 0xFFFFFF || *ptr == '-' || *ptr == '+')
+				parray_trgm_syntax_error(str);
+			ptr = end;
+			skip_spaces(&ptr);
+			if (ptr == end && *ptr != ']')
+				parray_trgm_syntax_error(str);
+
+			if (nkeys >= maxkeys)
+			{
+				maxkeys *= 2;
+				keys = (uint32 *) repalloc(keys, sizeof(uint32) * maxkeys);
+			}
+			keys[nkeys++] = (uint32) key;
+		}
+		ptr++;
+		skip_spaces(&ptr);
+
+		nkeys = first + sort_item_keys(keys + first, nkeys - first);
+
+		if (nitems >= maxitems)
+		{
+			maxitems *= 2;
+			offsets = (uint32 *) repalloc(offsets,
+										  sizeof(uint32) * (maxitems + 1));
+		}
+		offsets[++nitems] = nkeys;
+	}
+	ptr++;
+	skip_spaces(&ptr);
+	if (*ptr != '\0')
+		parray_trgm_syntax_error(str);
+
+	result = (ParrayTrgm *) palloc(PARRAY_TRGM_SIZE(nitems, nkeys));
+	SET_VARSIZE(result, PARRAY_TRGM_SIZE(nitems, nkeys));
+	result->nitems = nitems;
+	memcpy(result->offsets, offsets, sizeof(uint32) * (nitems + 1));
+	memcpy(PARRAY_TRGM_KEYS(result), keys, sizeof(uint32) * nkeys);
+
+	pfree(offsets);
+	pfree(keys);
+	PG_RETURN_POINTER(result);
+}
+
+Datum
+parray_trgm_out(PG_FUNCTION_ARGS)
+{
+	ParrayTrgm *pt = PG_GETARG_PARRAY_TRGM_P(0);
+	StringInfoData buf;
+	int			i,
+				j;
+
+	initStringInfo(&buf);
+	appendStringInfoChar(&buf, '{');
+	for (i = 0; i < pt->nitems; i++)
+	{
+		uint32	   *keys = PARRAY_TRGM_ITEM(pt, i);
+
+		if (i > 0)
+			appendStringInfoChar(&buf, ',');
+		appendStringInfoChar(&buf, '[');
+		for (j = 0; j < PARRAY_TRGM_NKEYS(pt, i); j++)
+			appendStringInfo(&buf, j > 0 ? " %06x" : "%06x", keys[j]);
+		appendStringInfoChar(&buf, ']');
+	}
+	appendStringInfoChar(&buf, '}');
+
+	PG_RETURN_CSTRING(buf.data);
+}
+
+/*
+ * Binary form is the number of items, then for each item the number of
+ * its keys and the keys as trgm2int values in any order
+ */
+Datum
+parray_trgm_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo	buf = (StringInfo) PG_GETARG_POINTER(0);
+	ParrayTrgm *result;
+	uint32	   *offsets,
+			   *keys;
+	int			nitems,
+				nkeys = 0,
+				maxkeys = 64,
+				i,
+				j;
+
+	nitems = (int) pq_getmsgint(buf, 4);
+	if (nitems < 0 || nitems > (buf->len - buf->cursor) / 4)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				 errmsg("invalid number of parray_trgm items: %d", nitems)));
+
+	offsets = (uint32 *) palloc(sizeof(uint32) * (nitems + 1));
+	keys = (uint32 *) palloc(sizeof(uint32) * maxkeys);
+	offsets[0] = 0;
+	for (i = 0; i < nitems; i++)
+	{
+		int			n = (int) pq_getmsgint(buf, 4);
+
+		if (n < 0 || n > (buf->len - buf->cursor) / 4)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					 errmsg("invalid number of parray_trgm keys: %d", n)));
+		while (nkeys + n > maxkeys)
+		{
+			maxkeys *= 2;
+			keys = (uint32 *) repalloc(keys, sizeof(uint32) * maxkeys);
+		}
+		for (j = 0; j < n; j++)
+		{
+			uint32		key = (uint32) pq_getmsgint(buf, 4);
+
+			if (key > 0xFFFFFF)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						 errmsg("invalid parray_trgm key: %x", key)));
+			keys[nkeys + j] = key;
+		}
+		nkeys += sort_item_keys(keys + nkeys, n);
+		offsets[i + 1] = nkeys;
+	}
+
+	result = (ParrayTrgm *) palloc(PARRAY_TRGM_SIZE(nitems, nkeys));
+	SET_VARSIZE(result, PARRAY_TRGM_SIZE(nitems, nkeys));
+	result->nitems = nitems;
+	memcpy(result->offsets, offsets, sizeof(uint32) * (nitems + 1));
+	memcpy(PARRAY_TRGM_KEYS(result), keys, sizeof(uint32) * nkeys);
+
+	pfree(offsets);
+	pfree(keys);
+	PG_RETURN_POINTER(result);
+}
+
+Datum
+parray_trgm_send(PG_FUNCTION_ARGS)
+{
+	ParrayTrgm *pt = PG_GETARG_PARRAY_TRGM_P(0);
+	StringInfoData buf;
+	int			i,
+				j;
+
+	pq_begintypsend(&buf);
+	pq_sendint32(&buf, pt->nitems);
+	for (i = 0; i < pt->nitems; i++)
+	{
+		uint32	   *item = PARRAY_TRGM_ITEM(pt, i);
+
+		pq_sendint32(&buf, PARRAY_TRGM_NKEYS(pt, i));
+		for (j = 0; j < PARRAY_TRGM_NKEYS(pt, i); j++)
+			pq_sendint32(&buf, item[j]);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/*
+ * Trigrams of every item of a text array
+ */
+Datum
+parray_trgm(PG_FUNCTION_ARGS)
+{
+	ArrayType  *array = PG_GETARG_ARRAYTYPE_P(0);
+	ParrayTrgm *result;
+	TRGM	  **trgs;
+	Datum	   *values;
+	bool	   *nulls;
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+	int			nitems,
+				nkeys = 0,
+				i;
+
+	get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval, &typalign);
+	deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval, typalign,
+					  &values, &nulls, &nitems);
+
+	trgs = (TRGM **) palloc0(Max(nitems, 1) * sizeof(TRGM *));
+	for (i = 0; i < nitems; i++)
+	{
+		text	   *item;
+
+		if (nulls[i])
+			continue;
+		item = DatumGetTextPP(values[i]);
+		trgs[i] = generate_trgm(VARDATA_ANY(item), VARSIZE_ANY_EXHDR(item));
+		nkeys += ARRNELEM(trgs[i]);
+	}
+
+	result = (ParrayTrgm *) palloc(PARRAY_TRGM_SIZE(nitems, nkeys));
+	SET_VARSIZE(result, PARRAY_TRGM_SIZE(nitems, nkeys));
+	result->nitems = nitems;
+	result->offsets[0] = 0;
+	for (i = 0; i < nitems; i++)
+	{
+		int			n = 0;
+
+		if (trgs[i])
+		{
+			n = pack_item_keys(trgs[i], PARRAY_TRGM_ITEM(result, i));
+			pfree(trgs[i]);
+		}
+		result->offsets[i + 1] = result->offsets[i] + n;
+	}
+
+	pfree(trgs);
+	pfree(values);
+	pfree(nulls);
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Packed trigrams of the right argument, an array of like patterns or
+ * a single text. Kept in fn_extra of the call site if there is one,
+ * made in the current context otherwise.
+ */
+static PatternKeys *
+pattern_keys_get(FmgrInfo *flinfo, struct varlena *arg, bool patterns)
+{
+	PatternKeys *pk = flinfo ? (PatternKeys *) flinfo->fn_extra : NULL;
+	int32		len = VARSIZE_ANY(arg);
+	MemoryContext oldContext;
+	int			i;
+
+	if (pk != NULL && pk->len == len && memcmp(pk->bytes, arg, len) == 0)
+		return pk;
+
+	if (flinfo == NULL)
+	{
+		pk = (PatternKeys *) palloc0(sizeof(PatternKeys));
+		pk->context = CurrentMemoryContext;
+	}
+	else if (pk == NULL)
+	{
+		pk = (PatternKeys *) MemoryContextAllocZero(flinfo->fn_mcxt,
+													sizeof(PatternKeys));
+		pk->context = AllocSetContextCreate(flinfo->fn_mcxt,
+											"parray_trgm pattern keys",
+											ALLOCSET_DEFAULT_SIZES);
+		flinfo->fn_extra = pk;
+	}
+	else
+		MemoryContextReset(pk->context);
+
+	oldContext = MemoryContextSwitchTo(pk->context);
+
+	if (patterns)
+	{
+		ArrayType  *array = (ArrayType *) arg;
+		Datum	   *values;
+		bool	   *nulls;
+		int16		typlen;
+		bool		typbyval;
+		char		typalign;
+
+		get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval,
+							 &typalign);
+		deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval,
+						  typalign, &values, &nulls, &pk->npatterns);
+
+		pk->keys = (uint32 **) palloc0(Max(pk->npatterns, 1) *
+									   sizeof(uint32 *));
+		pk->nkeys = (int *) palloc0(Max(pk->npatterns, 1) * sizeof(int));
+		for (i = 0; i < pk->npatterns; i++)
+		{
+			text	   *pattern;
+			TRGM	   *trg;
+
+			if (nulls[i])
+				continue;
+			pattern = DatumGetTextPP(values[i]);
+			trg = generate_wildcard_trgm(VARDATA_ANY(pattern),
+										 VARSIZE_ANY_EXHDR(pattern));
+			pk->keys[i] = (uint32 *) palloc(Max(ARRNELEM(trg), 1) *
+											sizeof(uint32));
+			pk->nkeys[i] = pack_item_keys(trg, pk->keys[i]);
+		}
+	}
+	else
+	{
+		TRGM	   *trg = generate_trgm(VARDATA_ANY(arg), VARSIZE_ANY_EXHDR(arg));
+
+		pk->npatterns = 1;
+		pk->keys = (uint32 **) palloc(sizeof(uint32 *));
+		pk->nkeys = (int *) palloc(sizeof(int));
+		pk->keys[0] = (uint32 *) palloc(Max(ARRNELEM(trg), 1) *
+										sizeof(uint32));
+		pk->nkeys[0] = pack_item_keys(trg, pk->keys[0]);
+	}
+
+	pk->bytes = palloc(len);
+	memcpy(pk->bytes, arg, len);
+	pk->len = len;
+
+	MemoryContextSwitchTo(oldContext);
+	return pk;
+}
+
+/*
+ * Prefilter for @@>: false if for some pattern no item has all of its
+ * trigrams, so the text array surely does not contain the patterns. True
+ * means the text array may contain them and @@> has to tell.
+ */
+Datum
+parray_trgm_contains_partial(PG_FUNCTION_ARGS)
+{
+	ParrayTrgm *pt = PG_GETARG_PARRAY_TRGM_P(0);
+	PatternKeys *pk = pattern_keys_get(fcinfo->flinfo,
+									   (struct varlena *) PG_GETARG_ARRAYTYPE_P(1),
+									   true);
+	int			i,
+				j;
+
+	for (j = 0; j < pk->npatterns; j++)
+	{
+		bool		found = false;
+
+		/* a null pattern matches nothing */
+		if (pk->keys[j] == NULL)
+			PG_RETURN_BOOL(false);
+
+		/* any item may match a pattern without trigrams */
+		if (pk->nkeys[j] == 0)
+			continue;
+
+		for (i = 0; i < pt->nitems && !found; i++)
+			found = keys_contained_by(pk->keys[j], pk->nkeys[j],
+									  PARRAY_TRGM_ITEM(pt, i),
+									  PARRAY_TRGM_NKEYS(pt, i));
+		if (!found)
+			PG_RETURN_BOOL(false);
+	}
+
+	PG_RETURN_BOOL(true);
+}
+
+/*
+ * Greatest trigram similarity of an item and a text, as similarity() of
+ * pg_trgm computes it
+ */
+static float4
+best_similarity(FunctionCallInfo fcinfo)
+{
+	ParrayTrgm *pt = PG_GETARG_PARRAY_TRGM_P(0);
+	PatternKeys *pk = pattern_keys_get(fcinfo->flinfo,
+									   (struct varlena *) PG_GETARG_TEXT_PP(1),
+									   false);
+	uint32	   *keys = pk->keys[0];
+	int			nkeys = pk->nkeys[0];
+	float4		best = 0;
+	int			i;
+
+	for (i = 0; i < pt->nitems; i++)
+	{
+		int			n = PARRAY_TRGM_NKEYS(pt, i);
+		int			count;
+		float4		sml;
+
+		if (n == 0 || nkeys == 0)
+			continue;
+		count = intersect_count(keys, nkeys, PARRAY_TRGM_ITEM(pt, i), n);
+#ifdef DIVUNION
+		sml = ((float4) count) / ((float4) (n + nkeys - count));
+#else
+		sml = ((float4) count) / ((float4) Max(n, nkeys));
+#endif
+		if (sml > best)
+			best = sml;
+	}
+
+	return best;
+}
+
+Datum
+parray_trgm_similarity(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT4(best_similarity(fcinfo));
+}
+
+Datum
+parray_trgm_distance(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT4(1.0 - best_similarity(fcinfo));
+}
+
+/* vim: set noexpandtab tabstop=4 shiftwidth=4 colorcolumn=80: */
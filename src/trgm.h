@@ -4,10 +4,9 @@
 #ifndef __TRGM_H__
 #define __TRGM_H__
 
-#include "access/gist.h"
-#include "access/itup.h"
-#include "storage/bufpage.h"
-#include "utils/builtins.h"
+#include "trgm_shim.h"
+
+#include <limits.h>
 
 /* options */
 #define LPADDING		2
@@ -105,5 +104,65 @@ TRGM	   *generate_trgm(char *str, int slen);
 TRGM	   *generate_wildcard_trgm(const char *str, int slen);
 float4		cnt_sml(TRGM *trg1, TRGM *trg2);
 bool		trgm_contained_by(TRGM *trg1, TRGM *trg2);
+trgm	   *make_trigrams(trgm *tptr, char *str, int bytelen, int charlen);
+
+/*
+ * Trigrams packed into uint32 keys sorted like CMPTRGM sorts trigrams,
+ * and intersection kernels for sorted arrays of unique keys.
+ */
+int			trgm_pack(TRGM *trg, uint32 *keys);
+/* a packed key XOR this is trgm2int of the trigram */
+#define TRGM_SORTKEY_FLIP		((CHAR_MIN < 0) ? 0x808080u : 0u)
+int			intersect_count(const uint32 *a, int na, const uint32 *b, int nb);
+int			intersect_count_merge(const uint32 *a, int na,
+								  const uint32 *b, int nb);
+int			intersect_count_gallop(const uint32 *a, int na,
+								   const uint32 *b, int nb);
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+int			intersect_count_sse2(const uint32 *a, int na,
+								 const uint32 *b, int nb);
+#endif
+bool		keys_contained_by(const uint32 *a, int na, const uint32 *b, int nb);
+
+/*
+ * Short keys (parray_gin addition). Keys for one and two character
+ * fragments live in their own namespace: upper byte of a key holds its
+ * kind, trigram keys always have zero there.
+ */
+#define SHORTKEY_KIND_SHIFT		24
+#define SHORTKEY_UNIGRAM		0x01
+#define SHORTKEY_BIGRAM			0x02
+/* single key marking a value with truncated items */
+#define TRUNCATED_KEY			((uint32) 0x05 << SHORTKEY_KIND_SHIFT)
+
+uint32	   *generate_short_keys(char *str, int slen, bool wildcard, int *nkeys);
+
+/*
+ * Word keys (parray_gin addition), a hash per lower-cased word of an item.
+ */
+char	  **generate_words(char *str, int slen, int *nwords);
+uint32		word_key(const char *word);
+uint32	   *generate_word_keys(char *str, int slen, int *nkeys);
+
+/*
+ * Wide trigrams (parray_gin addition). Three code points of 21 bits each
+ * packed into 63 bits, so they never collide unlike the three byte
+ * trigrams. Short keys are mapped to negative values.
+ */
+#define WIDE_CHAR_BITS			21
+#define WIDE_CHAR_MASK			0x1FFFFF
+#define WIDE_SHORTKEY_FLAG		(UINT64CONST(1) << 63)
+
+uint64	   *generate_wide_trgm(char *str, int slen, bool wildcard, int *nkeys);
+
+typedef void (*wide_trgm_callback) (uint64 trigram, const char *str,
+									int bytelen, void *arg);
+
+void		walk_wide_trgm(char *str, int slen, bool wildcard,
+						   wide_trgm_callback callback, void *arg);
+
+/* all keys of an item, trigrams (as trgm2int) and then short keys */
+uint64	   *generate_item_keys(char *str, int slen, bool wide, bool isQuery,
+							   bool wildcard, bool shortKeys, int *nkeys);
 
 #endif   /* __TRGM_H__ */
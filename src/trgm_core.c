@@ -0,0 +1,1201 @@
+/*
+ * Trigram and short key generation shared by the extension and the
+ * standalone benchmark, see trgm_shim.h. Split out of contrib/pg_trgm/trgm_op.c.
+ */
+#include "trgm_shim.h"
+
+#include <ctype.h>
+#include <limits.h>
+
+#include "trgm.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define TRGM_USE_SSE2
+#endif
+
+static int
+comp_trgm(const void *a, const void *b)
+{
+	return CMPTRGM(a, b);
+}
+
+static int
+unique_array(trgm *a, int len)
+{
+	trgm	   *curend,
+			   *tmp;
+
+	curend = tmp = a;
+	while (tmp - a < len)
+		if (CMPTRGM(tmp, curend))
+		{
+			curend++;
+			CPTRGM(curend, tmp);
+			tmp++;
+		}
+		else
+			tmp++;
+
+	return curend + 1 - a;
+}
+
+#ifdef KEEPONLYALNUM
+#if PG_VERSION_NUM >= 180000
+#define iswordchr(c)	(t_isalnum(c))
+#else
+#define iswordchr(c)	(t_isalpha(c) || t_isdigit(c))
+#endif
+#else
+#define iswordchr(c)	(!t_isspace(c))
+#endif
+
+/*
+ * Finds first word in string, returns pointer to the word,
+ * endword points to the character after word
+ */
+static char *
+find_word(char *str, int lenstr, char **endword, int *charlen)
+{
+	char	   *beginword = str;
+
+	while (beginword - str < lenstr && !iswordchr(beginword))
+		beginword += pg_mblen(beginword);
+
+	if (beginword - str >= lenstr)
+		return NULL;
+
+	*endword = beginword;
+	*charlen = 0;
+	while (*endword - str < lenstr && iswordchr(*endword))
+	{
+		*endword += pg_mblen(*endword);
+		(*charlen)++;
+	}
+
+	return beginword;
+}
+
+#ifdef USE_WIDE_UPPER_LOWER
+static void
+cnt_trigram(trgm *tptr, char *str, int bytelen)
+{
+	if (bytelen == 3)
+	{
+		CPTRGM(tptr, str);
+	}
+	else
+	{
+		pg_crc32	crc;
+
+		TRGM_CRC32(crc, str, bytelen);
+
+		/*
+		 * use only 3 upper bytes from crc, hope, it's good enough hashing
+		 */
+		CPTRGM(tptr, &crc);
+	}
+}
+#endif
+
+/*
+ * Adds trigrams from words (already padded).
+ */
+trgm *
+make_trigrams(trgm *tptr, char *str, int bytelen, int charlen)
+{
+	char	   *ptr = str;
+
+	if (charlen < 3)
+		return tptr;
+
+#ifdef USE_WIDE_UPPER_LOWER
+	if (pg_database_encoding_max_length() > 1)
+	{
+		int			lenfirst = pg_mblen(str),
+					lenmiddle = pg_mblen(str + lenfirst),
+					lenlast = pg_mblen(str + lenfirst + lenmiddle);
+
+		while ((ptr - str) + lenfirst + lenmiddle + lenlast <= bytelen)
+		{
+			cnt_trigram(tptr, ptr, lenfirst + lenmiddle + lenlast);
+
+			ptr += lenfirst;
+			tptr++;
+
+			lenfirst = lenmiddle;
+			lenmiddle = lenlast;
+			lenlast = pg_mblen(ptr + lenfirst + lenmiddle);
+		}
+	}
+	else
+#endif
+	{
+		Assert(bytelen == charlen);
+
+		while (ptr - str < bytelen - 2 /* number of trigrams = strlen - 2 */ )
+		{
+			CPTRGM(tptr, ptr);
+			ptr++;
+			tptr++;
+		}
+	}
+
+	return tptr;
+}
+
+TRGM *
+generate_trgm(char *str, int slen)
+{
+	TRGM	   *trg;
+	char	   *buf;
+	trgm	   *tptr;
+	int			len,
+				charlen,
+				bytelen;
+	char	   *bword,
+			   *eword;
+
+	trg = (TRGM *) palloc(TRGMHDRSIZE + sizeof(trgm) * (slen / 2 + 1) *3);
+	trg->flag = ARRKEY;
+	SET_VARSIZE(trg, TRGMHDRSIZE);
+
+	if (slen + LPADDING + RPADDING < 3 || slen == 0)
+		return trg;
+
+	tptr = GETARR(trg);
+
+	buf = palloc(sizeof(char) * (slen + 4));
+
+	if (LPADDING > 0)
+	{
+		*buf = ' ';
+		if (LPADDING > 1)
+			*(buf + 1) = ' ';
+	}
+
+	eword = str;
+	while ((bword = find_word(eword, slen - (eword - str), &eword, &charlen)) != NULL)
+	{
+#ifdef IGNORECASE
+		bword = trgm_lower(bword, eword - bword);
+		bytelen = strlen(bword);
+#else
+		bytelen = eword - bword;
+#endif
+
+		memcpy(buf + LPADDING, bword, bytelen);
+
+#ifdef IGNORECASE
+		pfree(bword);
+#endif
+		buf[LPADDING + bytelen] = ' ';
+		buf[LPADDING + bytelen + 1] = ' ';
+
+		/*
+		 * count trigrams
+		 */
+		tptr = make_trigrams(tptr, buf, bytelen + LPADDING + RPADDING,
+							 charlen + LPADDING + RPADDING);
+	}
+
+	pfree(buf);
+
+	if ((len = tptr - GETARR(trg)) == 0)
+		return trg;
+
+	if (len > 0)
+	{
+		qsort((void *) GETARR(trg), len, sizeof(trgm), comp_trgm);
+		len = unique_array(GETARR(trg), len);
+	}
+
+	SET_VARSIZE(trg, CALCGTSIZE(ARRKEY, len));
+
+	return trg;
+}
+
+/*
+ * Extract the next non-wildcard part of a search string, ie, a word bounded
+ * by '_' or '%' meta-characters, non-word characters or string end.
+ *
+ * str: source string, of length lenstr bytes (need not be null-terminated)
+ * buf: where to return the substring (must be long enough)
+ * *bytelen: receives byte length of the found substring
+ * *charlen: receives character length of the found substring
+ *
+ * Returns pointer to end+1 of the found substring in the source string.
+ * Returns NULL if no word found (in which case buf, bytelen, charlen not set)
+ *
+ * If the found word is bounded by non-word characters or string boundaries
+ * then this function will include corresponding padding spaces into buf.
+ */
+static const char *
+get_wildcard_part(const char *str, int lenstr,
+				  char *buf, int *bytelen, int *charlen)
+{
+	const char *beginword = str;
+	const char *endword;
+	char	   *s = buf;
+	bool		in_leading_wildcard_meta = false;
+	bool		in_trailing_wildcard_meta = false;
+	bool		in_escape = false;
+	int			clen;
+
+	/*
+	 * Find the first word character, remembering whether preceding character
+	 * was wildcard meta-character.  Note that the in_escape state persists
+	 * from this loop to the next one, since we may exit at a word character
+	 * that is in_escape.
+	 */
+	while (beginword - str < lenstr)
+	{
+		if (in_escape)
+		{
+			if (iswordchr(beginword))
+				break;
+			in_escape = false;
+			in_leading_wildcard_meta = false;
+		}
+		else
+		{
+			if (ISESCAPECHAR(beginword))
+				in_escape = true;
+			else if (ISWILDCARDCHAR(beginword))
+				in_leading_wildcard_meta = true;
+			else if (iswordchr(beginword))
+				break;
+			else
+				in_leading_wildcard_meta = false;
+		}
+		beginword += pg_mblen(beginword);
+	}
+
+	/*
+	 * Handle string end.
+	 */
+	if (beginword - str >= lenstr)
+		return NULL;
+
+	/*
+	 * Add left padding spaces if preceding character wasn't wildcard
+	 * meta-character.
+	 */
+	*charlen = 0;
+	if (!in_leading_wildcard_meta)
+	{
+		if (LPADDING > 0)
+		{
+			*s++ = ' ';
+			(*charlen)++;
+			if (LPADDING > 1)
+			{
+				*s++ = ' ';
+				(*charlen)++;
+			}
+		}
+	}
+
+	/*
+	 * Copy data into buf until wildcard meta-character, non-word character or
+	 * string boundary.  Strip escapes during copy.
+	 */
+	endword = beginword;
+	while (endword - str < lenstr)
+	{
+		clen = pg_mblen(endword);
+		if (in_escape)
+		{
+			if (iswordchr(endword))
+			{
+				memcpy(s, endword, clen);
+				(*charlen)++;
+				s += clen;
+			}
+			else
+			{
+				/*
+				 * Back up endword to the escape character when stopping at
+				 * an escaped char, so that subsequent get_wildcard_part will
+				 * restart from the escape character.  We assume here that
+				 * escape chars are single-byte.
+				 */
+				endword--;
+				break;
+			}
+			in_escape = false;
+		}
+		else
+		{
+			if (ISESCAPECHAR(endword))
+				in_escape = true;
+			else if (ISWILDCARDCHAR(endword))
+			{
+				in_trailing_wildcard_meta = true;
+				break;
+			}
+			else if (iswordchr(endword))
+			{
+				memcpy(s, endword, clen);
+				(*charlen)++;
+				s += clen;
+			}
+			else
+				break;
+		}
+		endword += clen;
+	}
+
+	/*
+	 * Add right padding spaces if next character isn't wildcard
+	 * meta-character.
+	 */
+	if (!in_trailing_wildcard_meta)
+	{
+		if (RPADDING > 0)
+		{
+			*s++ = ' ';
+			(*charlen)++;
+			if (RPADDING > 1)
+			{
+				*s++ = ' ';
+				(*charlen)++;
+			}
+		}
+	}
+
+	*bytelen = s - buf;
+	return endword;
+}
+
+/*
+ * Generates trigrams for wildcard search string.
+ *
+ * Returns array of trigrams that must occur in any string that matches the
+ * wildcard string.  For example, given pattern "a%bcd%" the trigrams
+ * " a", "bcd" would be extracted.
+ */
+TRGM *
+generate_wildcard_trgm(const char *str, int slen)
+{
+	TRGM	   *trg;
+	char	   *buf,
+			   *buf2;
+	trgm	   *tptr;
+	int			len,
+				charlen,
+				bytelen;
+	const char *eword;
+
+	trg = (TRGM *) palloc(TRGMHDRSIZE + sizeof(trgm) * (slen / 2 + 1) *3);
+	trg->flag = ARRKEY;
+	SET_VARSIZE(trg, TRGMHDRSIZE);
+
+	if (slen + LPADDING + RPADDING < 3 || slen == 0)
+		return trg;
+
+	tptr = GETARR(trg);
+
+	buf = palloc(sizeof(char) * (slen + 4));
+
+	/*
+	 * Extract trigrams from each substring extracted by get_wildcard_part.
+	 */
+	eword = str;
+	while ((eword = get_wildcard_part(eword, slen - (eword - str),
+									  buf, &bytelen, &charlen)) != NULL)
+	{
+#ifdef IGNORECASE
+		buf2 = trgm_lower(buf, bytelen);
+		bytelen = strlen(buf2);
+#else
+		buf2 = buf;
+#endif
+
+		/*
+		 * count trigrams
+		 */
+		tptr = make_trigrams(tptr, buf2, bytelen, charlen);
+#ifdef IGNORECASE
+		pfree(buf2);
+#endif
+	}
+
+	pfree(buf);
+
+	if ((len = tptr - GETARR(trg)) == 0)
+		return trg;
+
+	/*
+	 * Make trigrams unique.
+	 */
+	if (len > 0)
+	{
+		qsort((void *) GETARR(trg), len, sizeof(trgm), comp_trgm);
+		len = unique_array(GETARR(trg), len);
+	}
+
+	SET_VARSIZE(trg, CALCGTSIZE(ARRKEY, len));
+
+	return trg;
+}
+
+/*
+ * Lower-cases a word the same way trigram generation does.
+ */
+static char *
+lower_word(const char *str, int len)
+{
+#ifdef IGNORECASE
+	return trgm_lower(str, len);
+#else
+	return pnstrdup(str, len);
+#endif
+}
+
+/*
+ * Makes a short key of given kind from one or two characters.
+ * Up to three bytes are stored as is, longer multibyte fragments are
+ * hashed (FNV-1a folded to 24 bits).
+ */
+static uint32
+short_key(uint32 kind, const char *str, int bytelen)
+{
+	const unsigned char *s = (const unsigned char *) str;
+	uint32		val = 0;
+	int			i;
+
+	if (bytelen <= 3)
+	{
+		for (i = 0; i < bytelen; i++)
+			val = (val << 8) | s[i];
+	}
+	else
+	{
+		val = 2166136261u;
+		for (i = 0; i < bytelen; i++)
+			val = (val ^ s[i]) * 16777619u;
+		val = (val >> 24) ^ (val & 0xFFFFFF);
+	}
+
+	return (kind << SHORTKEY_KIND_SHIFT) | (val & 0xFFFFFF);
+}
+
+/*
+ * Adds short keys for a lower-cased run of word characters, at most two
+ * keys per byte. Indexed words give a unigram for every character and
+ * a bigram for every pair of adjacent characters. Pattern fragments give
+ * only what any matching word must contain: a unigram for a single
+ * character, bigrams otherwise.
+ */
+static uint32 *
+make_short_keys(uint32 *kptr, const char *str, int bytelen, bool wildcard)
+{
+	const char *ptr = str;
+	int			clen,
+				nclen;
+
+	while (ptr - str < bytelen)
+	{
+		clen = pg_mblen(ptr);
+		if (ptr - str + clen < bytelen)
+		{
+			nclen = pg_mblen(ptr + clen);
+			*kptr++ = short_key(SHORTKEY_BIGRAM, ptr, clen + nclen);
+		}
+		if (!wildcard || clen == bytelen)
+			*kptr++ = short_key(SHORTKEY_UNIGRAM, ptr, clen);
+		ptr += clen;
+	}
+
+	return kptr;
+}
+
+static int
+comp_uint32(const void *a, const void *b)
+{
+	uint32		ua = *(const uint32 *) a;
+	uint32		ub = *(const uint32 *) b;
+
+	return (ua > ub) ? 1 : ((ua < ub) ? -1 : 0);
+}
+
+/*
+ * Generates sorted unique short keys for a string or, if wildcard is set,
+ * for a wildcard search string. Intended for strings too short to have
+ * trigrams, i.e. "%x%" or "%xy%" patterns.
+ */
+uint32 *
+generate_short_keys(char *str, int slen, bool wildcard, int *nkeys)
+{
+	uint32	   *keys,
+			   *kptr;
+	int			maxkeys = 2 * (slen + 1);
+	int			len,
+				i,
+				charlen,
+				bytelen;
+	char	   *buf,
+			   *word;
+
+	keys = kptr = (uint32 *) palloc(sizeof(uint32) * maxkeys);
+	buf = palloc(sizeof(char) * (slen + 4));
+
+	if (!wildcard)
+	{
+		char	   *bword,
+				   *eword = str;
+
+		while ((bword = find_word(eword, slen - (eword - str),
+								  &eword, &charlen)) != NULL)
+		{
+			word = lower_word(bword, eword - bword);
+			bytelen = strlen(word);
+
+			len = kptr - keys;
+			if (len + 2 * bytelen > maxkeys)
+			{
+				maxkeys = 2 * maxkeys + 2 * bytelen;
+				keys = (uint32 *) repalloc(keys, sizeof(uint32) * maxkeys);
+				kptr = keys + len;
+			}
+			kptr = make_short_keys(kptr, word, bytelen, false);
+			pfree(word);
+		}
+	}
+	else
+	{
+		const char *eword = str;
+
+		while ((eword = get_wildcard_part(eword, slen - (eword - str),
+										  buf, &bytelen, &charlen)) != NULL)
+		{
+			char	   *bpart = buf;
+
+			/* padding spaces are not word characters, strip them */
+			while (bytelen > 0 && *bpart == ' ')
+			{
+				bpart++;
+				bytelen--;
+			}
+			while (bytelen > 0 && bpart[bytelen - 1] == ' ')
+				bytelen--;
+			if (bytelen == 0)
+				continue;
+
+			word = lower_word(bpart, bytelen);
+			bytelen = strlen(word);
+
+			len = kptr - keys;
+			if (len + 2 * bytelen > maxkeys)
+			{
+				maxkeys = 2 * maxkeys + 2 * bytelen;
+				keys = (uint32 *) repalloc(keys, sizeof(uint32) * maxkeys);
+				kptr = keys + len;
+			}
+			kptr = make_short_keys(kptr, word, bytelen, true);
+			pfree(word);
+		}
+	}
+
+	pfree(buf);
+
+	len = kptr - keys;
+	if (len > 1)
+	{
+		qsort((void *) keys, len, sizeof(uint32), comp_uint32);
+		for (i = 1, kptr = keys; i < len; i++)
+			if (keys[i] != *kptr)
+				*++kptr = keys[i];
+		len = kptr + 1 - keys;
+	}
+
+	*nkeys = len;
+	return keys;
+}
+
+/*
+ * Splits a string into lower-cased words, tokenized like trigram generation
+ * does. Returns an array of palloc'd null-terminated words, duplicates are
+ * kept.
+ */
+char	  **
+generate_words(char *str, int slen, int *nwords)
+{
+	char	  **words;
+	char	   *bword,
+			   *eword = str;
+	int			maxwords = 8,
+				len = 0,
+				charlen;
+
+	words = (char **) palloc(sizeof(char *) * maxwords);
+	while ((bword = find_word(eword, slen - (eword - str),
+							  &eword, &charlen)) != NULL)
+	{
+		if (len >= maxwords)
+		{
+			maxwords *= 2;
+			words = (char **) repalloc(words, sizeof(char *) * maxwords);
+		}
+		words[len++] = lower_word(bword, eword - bword);
+	}
+
+	*nwords = len;
+	return words;
+}
+
+/*
+ * Key of a lower-cased word, FNV-1a of its bytes.
+ */
+uint32
+word_key(const char *word)
+{
+	const unsigned char *s = (const unsigned char *) word;
+	uint32		val = 2166136261u;
+
+	while (*s)
+		val = (val ^ *s++) * 16777619u;
+	return val;
+}
+
+/*
+ * Generates sorted unique word keys for a string.
+ */
+uint32 *
+generate_word_keys(char *str, int slen, int *nkeys)
+{
+	char	  **words;
+	uint32	   *keys,
+			   *kptr;
+	int			nwords,
+				len,
+				i;
+
+	words = generate_words(str, slen, &nwords);
+	keys = (uint32 *) palloc(sizeof(uint32) * Max(nwords, 1));
+	for (i = 0; i < nwords; i++)
+	{
+		keys[i] = word_key(words[i]);
+		pfree(words[i]);
+	}
+	pfree(words);
+
+	len = nwords;
+	if (len > 1)
+	{
+		qsort((void *) keys, len, sizeof(uint32), comp_uint32);
+		for (i = 1, kptr = keys; i < len; i++)
+			if (keys[i] != *kptr)
+				*++kptr = keys[i];
+		len = kptr + 1 - keys;
+	}
+
+	*nkeys = len;
+	return keys;
+}
+
+/*
+ * Returns code point of a character folded to WIDE_CHAR_BITS. Only
+ * multibyte encodings other than UTF8 may have wider characters.
+ */
+static uint64
+wide_char(const char *str, int clen)
+{
+	pg_wchar	wc[2];
+
+	pg_mb2wchar_with_len(str, wc, clen);
+	if (wc[0] > WIDE_CHAR_MASK)
+		wc[0] = (wc[0] ^ (wc[0] >> WIDE_CHAR_BITS)) & WIDE_CHAR_MASK;
+
+	return (uint64) wc[0];
+}
+
+/*
+ * Passes wide trigrams from a word (already padded) to the callback
+ * along with their bytes.
+ */
+static void
+make_wide_trigrams(char *str, int bytelen, int charlen,
+				   wide_trgm_callback callback, void *arg)
+{
+	char	   *ptr = str;
+	int			lenfirst,
+				lenmiddle,
+				lenlast;
+	uint64		first,
+				middle,
+				last;
+
+	if (charlen < 3)
+		return;
+
+	lenfirst = pg_mblen(ptr);
+	lenmiddle = pg_mblen(ptr + lenfirst);
+	lenlast = pg_mblen(ptr + lenfirst + lenmiddle);
+	first = wide_char(ptr, lenfirst);
+	middle = wide_char(ptr + lenfirst, lenmiddle);
+
+	while ((ptr - str) + lenfirst + lenmiddle + lenlast <= bytelen)
+	{
+		last = wide_char(ptr + lenfirst + lenmiddle, lenlast);
+		callback((first << (2 * WIDE_CHAR_BITS)) |
+				 (middle << WIDE_CHAR_BITS) | last,
+				 ptr, lenfirst + lenmiddle + lenlast, arg);
+
+		ptr += lenfirst;
+		first = middle;
+		lenfirst = lenmiddle;
+		middle = last;
+		lenmiddle = lenlast;
+		lenlast = pg_mblen(ptr + lenfirst + lenmiddle);
+	}
+}
+
+/*
+ * Walks wide trigrams of a string or a wildcard search string. Words are
+ * padded and lower-cased exactly like generate_trgm and
+ * generate_wildcard_trgm do.
+ */
+void
+walk_wide_trgm(char *str, int slen, bool wildcard,
+			   wide_trgm_callback callback, void *arg)
+{
+	char	   *buf,
+			   *word;
+	int			charlen,
+				bytelen;
+
+	if (slen + LPADDING + RPADDING < 3 || slen == 0)
+		return;
+
+	if (!wildcard)
+	{
+		char	   *bword,
+				   *eword = str;
+
+		while ((bword = find_word(eword, slen - (eword - str),
+								  &eword, &charlen)) != NULL)
+		{
+			word = lower_word(bword, eword - bword);
+			bytelen = strlen(word);
+
+			buf = palloc(sizeof(char) * (bytelen + 4));
+			memset(buf, ' ', LPADDING);
+			memcpy(buf + LPADDING, word, bytelen);
+			buf[LPADDING + bytelen] = ' ';
+			buf[LPADDING + bytelen + 1] = ' ';
+
+			make_wide_trigrams(buf, bytelen + LPADDING + RPADDING,
+							   charlen + LPADDING + RPADDING, callback, arg);
+			pfree(buf);
+			pfree(word);
+		}
+	}
+	else
+	{
+		const char *eword = str;
+
+		buf = palloc(sizeof(char) * (slen + 4));
+		while ((eword = get_wildcard_part(eword, slen - (eword - str),
+										  buf, &bytelen, &charlen)) != NULL)
+		{
+			word = lower_word(buf, bytelen);
+			make_wide_trigrams(word, strlen(word), charlen, callback, arg);
+			pfree(word);
+		}
+		pfree(buf);
+	}
+}
+
+typedef struct
+{
+	uint64	   *keys;
+	int			nkeys;
+	int			maxkeys;
+} WideTrgmArray;
+
+static void
+add_wide_trgm(uint64 trigram, const char *str, int bytelen, void *arg)
+{
+	WideTrgmArray *arr = (WideTrgmArray *) arg;
+
+	/* bytes of the trigram are for callbacks checking collisions */
+	(void) str;
+	(void) bytelen;
+
+	if (arr->nkeys >= arr->maxkeys)
+	{
+		arr->maxkeys *= 2;
+		arr->keys = (uint64 *) repalloc(arr->keys,
+										sizeof(uint64) * arr->maxkeys);
+	}
+	arr->keys[arr->nkeys++] = trigram;
+}
+
+static int
+comp_uint64(const void *a, const void *b)
+{
+	uint64		ua = *(const uint64 *) a;
+	uint64		ub = *(const uint64 *) b;
+
+	return (ua > ub) ? 1 : ((ua < ub) ? -1 : 0);
+}
+
+/*
+ * Generates sorted unique wide trigrams of a string or, if wildcard is set,
+ * of a wildcard search string.
+ */
+uint64 *
+generate_wide_trgm(char *str, int slen, bool wildcard, int *nkeys)
+{
+	WideTrgmArray arr;
+	int			i;
+
+	arr.maxkeys = slen + 8;
+	arr.nkeys = 0;
+	arr.keys = (uint64 *) palloc(sizeof(uint64) * arr.maxkeys);
+
+	walk_wide_trgm(str, slen, wildcard, add_wide_trgm, &arr);
+
+	if (arr.nkeys > 1)
+	{
+		uint64	   *kptr = arr.keys;
+
+		qsort((void *) arr.keys, arr.nkeys, sizeof(uint64), comp_uint64);
+		for (i = 1; i < arr.nkeys; i++)
+			if (arr.keys[i] != *kptr)
+				*++kptr = arr.keys[i];
+		arr.nkeys = kptr + 1 - arr.keys;
+	}
+
+	*nkeys = arr.nkeys;
+	return arr.keys;
+}
+
+uint32
+trgm2int(trgm *ptr)
+{
+	uint32		val = 0;
+
+	val |= *(((unsigned char *) ptr));
+	val <<= 8;
+	val |= *(((unsigned char *) ptr) + 1);
+	val <<= 8;
+	val |= *(((unsigned char *) ptr) + 2);
+
+	return val;
+}
+
+/*
+ * Packs a trigram into an integer ordered like CMPTRGM orders trigrams.
+ * CMPTRGM compares plain chars, so with signed char bytes are flipped to
+ * keep negative chars below positive ones.
+ */
+static inline uint32
+trgm2sortkey(const trgm *ptr)
+{
+	const unsigned char *s = (const unsigned char *) ptr;
+
+	return (((uint32) s[0] << 16) | ((uint32) s[1] << 8) | s[2]) ^
+		TRGM_SORTKEY_FLIP;
+}
+
+/*
+ * Packs sorted trigrams of a TRGM into keys, which end up sorted
+ * ascending. Returns number of keys.
+ */
+int
+trgm_pack(TRGM *trg, uint32 *keys)
+{
+	trgm	   *ptr = GETARR(trg);
+	int			len = ARRNELEM(trg);
+	int			i;
+
+	for (i = 0; i < len; i++)
+		keys[i] = trgm2sortkey(ptr++);
+	return len;
+}
+
+/*
+ * Intersection kernels for sorted arrays of unique uint32 keys.
+ *
+ * The merge kernel is branch-light and best for small sets. The SSE2
+ * kernel compares blocks of four keys with all rotations of the other
+ * block, it wins for balanced sets of dozens of keys and more. Galloping
+ * (exponential search of every key of the smaller set in the larger one)
+ * wins when one set is much larger than the other.
+ */
+int
+intersect_count_merge(const uint32 *a, int na, const uint32 *b, int nb)
+{
+	int			i = 0,
+				j = 0,
+				count = 0;
+
+	while (i < na && j < nb)
+	{
+		uint32		x = a[i],
+					y = b[j];
+
+		count += (x == y);
+		i += (x <= y);
+		j += (y <= x);
+	}
+	return count;
+}
+
+/* first index in b[lo..nb) with b[index] >= key, or nb */
+static inline int
+gallop(const uint32 *b, int lo, int nb, uint32 key)
+{
+	int			step = 1,
+				hi;
+
+	while (lo + step < nb && b[lo + step] < key)
+		step <<= 1;
+	hi = Min(lo + step, nb);
+	lo += step >> 1;
+	while (lo < hi)
+	{
+		int			mid = lo + ((hi - lo) >> 1);
+
+		if (b[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+int
+intersect_count_gallop(const uint32 *a, int na, const uint32 *b, int nb)
+{
+	int			i,
+				j = 0,
+				count = 0;
+
+	for (i = 0; i < na && j < nb; i++)
+	{
+		j = gallop(b, j, nb, a[i]);
+		if (j < nb && b[j] == a[i])
+		{
+			count++;
+			j++;
+		}
+	}
+	return count;
+}
+
+#ifdef TRGM_USE_SSE2
+/* set bits of a 4-bit movemask */
+static const uint8 mask_bits[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+int
+intersect_count_sse2(const uint32 *a, int na, const uint32 *b, int nb)
+{
+	int			i = 0,
+				j = 0,
+				count = 0;
+	int			na4 = na & ~3,
+				nb4 = nb & ~3;
+
+	while (i < na4 && j < nb4)
+	{
+		__m128i		va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i		vb = _mm_loadu_si128((const __m128i *) (b + j));
+		__m128i		eq;
+		uint32		amax = a[i + 3],
+					bmax = b[j + 3];
+
+		eq = _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+						  _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+		eq = _mm_or_si128(eq,
+						  _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+		eq = _mm_or_si128(eq,
+						  _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+		/* keys are unique, a key of a matches at most once overall */
+		count += mask_bits[_mm_movemask_ps(_mm_castsi128_ps(eq))];
+
+		i += (amax <= bmax) ? 4 : 0;
+		j += (bmax <= amax) ? 4 : 0;
+	}
+	return count + intersect_count_merge(a + i, na - i, b + j, nb - j);
+}
+#endif
+
+/* Picks an intersection kernel by set sizes */
+int
+intersect_count(const uint32 *a, int na, const uint32 *b, int nb)
+{
+	if (na > nb)
+	{
+		const uint32 *t = a;
+		int			n = na;
+
+		a = b;
+		na = nb;
+		b = t;
+		nb = n;
+	}
+	if (na == 0)
+		return 0;
+	if (nb / na >= 32)
+		return intersect_count_gallop(a, na, b, nb);
+#ifdef TRGM_USE_SSE2
+	if (na >= 8)
+		return intersect_count_sse2(a, na, b, nb);
+#endif
+	return intersect_count_merge(a, na, b, nb);
+}
+
+/* Returns whether every key of a is found in b */
+bool
+keys_contained_by(const uint32 *a, int na, const uint32 *b, int nb)
+{
+	int			i,
+				j = 0;
+
+	if (na > nb)
+		return false;
+	if (nb / Max(na, 1) >= 32)
+	{
+		for (i = 0; i < na; i++)
+		{
+			j = gallop(b, j, nb, a[i]);
+			if (j == nb || b[j] != a[i])
+				return false;
+			j++;
+		}
+		return true;
+	}
+	for (i = 0; i < na; i++)
+	{
+		while (j < nb && b[j] < a[i])
+			j++;
+		if (j == nb || b[j] != a[i])
+			return false;
+		j++;
+	}
+	return true;
+}
+
+/* keys of a TRGM on stack if small enough */
+#define PACKED_STACK_KEYS	256
+
+float4
+cnt_sml(TRGM *trg1, TRGM *trg2)
+{
+	uint32		buf1[PACKED_STACK_KEYS],
+				buf2[PACKED_STACK_KEYS];
+	uint32	   *keys1 = buf1,
+			   *keys2 = buf2;
+	int			count,
+				len1 = ARRNELEM(trg1),
+				len2 = ARRNELEM(trg2);
+
+	if (len1 > PACKED_STACK_KEYS)
+		keys1 = (uint32 *) palloc(sizeof(uint32) * len1);
+	if (len2 > PACKED_STACK_KEYS)
+		keys2 = (uint32 *) palloc(sizeof(uint32) * len2);
+	trgm_pack(trg1, keys1);
+	trgm_pack(trg2, keys2);
+
+	count = intersect_count(keys1, len1, keys2, len2);
+
+	if (keys1 != buf1)
+		pfree(keys1);
+	if (keys2 != buf2)
+		pfree(keys2);
+
+#ifdef DIVUNION
+	return ((((float4) count) / ((float4) (len1 + len2 - count))));
+#else
+	return (((float) count) / ((float) ((len1 > len2) ? len1 : len2)));
+#endif
+
+}
+
+/*
+ * Returns whether trg2 contains all trigrams in trg1.
+ * This relies on the trigram arrays being sorted.
+ */
+bool
+trgm_contained_by(TRGM *trg1, TRGM *trg2)
+{
+	uint32		buf1[PACKED_STACK_KEYS],
+				buf2[PACKED_STACK_KEYS];
+	uint32	   *keys1 = buf1,
+			   *keys2 = buf2;
+	int			len1 = ARRNELEM(trg1),
+				len2 = ARRNELEM(trg2);
+	bool		res;
+
+	if (len1 > len2)
+		return false;
+	if (len1 > PACKED_STACK_KEYS)
+		keys1 = (uint32 *) palloc(sizeof(uint32) * len1);
+	if (len2 > PACKED_STACK_KEYS)
+		keys2 = (uint32 *) palloc(sizeof(uint32) * len2);
+	trgm_pack(trg1, keys1);
+	trgm_pack(trg2, keys2);
+
+	res = keys_contained_by(keys1, len1, keys2, len2);
+
+	if (keys1 != buf1)
+		pfree(keys1);
+	if (keys2 != buf2)
+		pfree(keys2);
+	return res;
+}
+
+/*
+ * Generates all keys of an item: sorted unique trigrams (wide trigrams if
+ * wide is set) followed by short keys if shortKeys is set. A search item
+ * (isQuery) gets short keys only when it has no trigrams at all.
+ * Trigrams are returned as trgm2int values. Wide short keys carry
+ * WIDE_SHORTKEY_FLAG.
+ */
+uint64 *
+generate_item_keys(char *str, int slen, bool wide, bool isQuery,
+				   bool wildcard, bool shortKeys, int *nkeys)
+{
+	uint64	   *keys;
+	uint32	   *skeys = NULL;
+	int			ntrgm,
+				nshort = 0,
+				i;
+
+	if (wide)
+		keys = generate_wide_trgm(str, slen, wildcard, &ntrgm);
+	else
+	{
+		TRGM	   *trg;
+		trgm	   *ptr;
+
+		trg = wildcard ? generate_wildcard_trgm(str, slen)
+			: generate_trgm(str, slen);
+		ntrgm = ARRNELEM(trg);
+		keys = (uint64 *) palloc(sizeof(uint64) * Max(ntrgm, 1));
+		ptr = GETARR(trg);
+		for (i = 0; i < ntrgm; i++)
+			keys[i] = trgm2int(ptr++);
+		pfree(trg);
+	}
+
+	if (shortKeys && (!isQuery || ntrgm == 0))
+		skeys = generate_short_keys(str, slen, wildcard, &nshort);
+
+	if (nshort > 0)
+	{
+		keys = (uint64 *) repalloc(keys, sizeof(uint64) * (ntrgm + nshort));
+		for (i = 0; i < nshort; i++)
+			keys[ntrgm + i] = wide ? (WIDE_SHORTKEY_FLAG | skeys[i])
+				: (uint64) skeys[i];
+	}
+	if (skeys)
+		pfree(skeys);
+
+	*nkeys = ntrgm + nshort;
+	return keys;
+}
@@ -0,0 +1,116 @@
+/*
+ * Environment of the trigram core (trgm_core.c).
+ *
+ * Inside the server this just pulls in the PostgreSQL headers the core
+ * needs. With TRGM_STANDALONE defined it declares the few server
+ * facilities the core uses instead, so the core can be built into a plain
+ * executable, see bench/trgm_shim.c. Standalone builds assume UTF8
+ * database encoding and lower-case with the C library.
+ */
+#ifndef __TRGM_SHIM_H__
+#define __TRGM_SHIM_H__
+
+#ifndef TRGM_STANDALONE
+
+#include "postgres.h"
+
+#include "mb/pg_wchar.h"
+#include "tsearch/ts_locale.h"
+#if PG_VERSION_NUM >= 90500
+#include "utils/pg_crc.h"
+#endif
+#if PG_VERSION_NUM >= 180000
+#include "catalog/pg_collation_d.h"
+#endif
+#include "utils/formatting.h"
+#include "access/gist.h"
+#include "access/itup.h"
+#include "storage/bufpage.h"
+#include "utils/builtins.h"
+
+#if PG_VERSION_NUM >= 180000
+#define trgm_lower(str, len)	str_tolower((str), (len), DEFAULT_COLLATION_OID)
+#else
+#define trgm_lower(str, len)	lowerstr_with_len((str), (len))
+#endif
+
+#if PG_VERSION_NUM >= 90500
+#define TRGM_CRC32(crc, str, len) do {		\
+	INIT_LEGACY_CRC32(crc);					\
+	COMP_LEGACY_CRC32(crc, str, len);		\
+	FIN_LEGACY_CRC32(crc);					\
+} while (0)
+#else
+#define TRGM_CRC32(crc, str, len) do {		\
+	INIT_CRC32(crc);						\
+	COMP_CRC32(crc, str, len);				\
+	FIN_CRC32(crc);							\
+} while (0)
+#endif
+
+#else							/* TRGM_STANDALONE */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int8_t int8;
+typedef uint8_t uint8;
+typedef int16_t int16;
+typedef uint16_t uint16;
+typedef int32_t int32;
+typedef uint32_t uint32;
+typedef int64_t int64;
+typedef uint64_t uint64;
+typedef float float4;
+typedef uint32 pg_wchar;
+typedef uint32 pg_crc32;
+
+#ifdef TRGM_ASSERT
+#include <assert.h>
+#define Assert(condition)	assert(condition)
+#else
+#define Assert(condition)	((void) 0)
+#endif
+
+#define UINT64CONST(x)		UINT64_C(x)
+#define Max(x, y)			((x) > (y) ? (x) : (y))
+#define Min(x, y)			((x) < (y) ? (x) : (y))
+
+/* only 4-byte varlena headers, never toasted */
+#define VARHDRSZ			((int32) sizeof(int32))
+#define SET_VARSIZE(ptr, len)	(*(int32 *) (ptr) = (int32) (len))
+#define VARSIZE(ptr)		(*(const int32 *) (ptr))
+
+/* memory, counted in trgm_shim_allocs */
+extern uint64 trgm_shim_allocs;
+extern void *palloc(size_t size);
+extern void *repalloc(void *ptr, size_t size);
+extern void pfree(void *ptr);
+extern char *pnstrdup(const char *str, size_t len);
+
+/* UTF8 encoding */
+extern int	pg_mblen(const char *str);
+extern int	pg_database_encoding_max_length(void);
+extern int	pg_mb2wchar_with_len(const char *from, pg_wchar *to, int len);
+
+/* character classes and case folding of the C library locale */
+extern int	t_isalpha(const char *ptr);
+extern int	t_isdigit(const char *ptr);
+extern int	t_isspace(const char *ptr);
+extern int	t_isalnum(const char *ptr);
+extern char *trgm_lower(const char *str, int len);
+
+/*
+ * Without wide character case folding (servers since PG 11 never define
+ * USE_WIDE_UPPER_LOWER) multibyte trigrams are taken bytewise, so the CRC
+ * is never needed.
+ */
+#undef USE_WIDE_UPPER_LOWER
+#define TRGM_CRC32(crc, str, len)	((crc) = 0)
+
+#endif							/* TRGM_STANDALONE */
+
+#endif							/* __TRGM_SHIM_H__ */
@@ -0,0 +1,93 @@
+set client_min_messages to 'error';
+drop extension if exists "parray_gin" cascade;
+create extension "parray_gin";
+set client_min_messages to 'warning';
+
+\t on
+\pset format unaligned
+
+-- fixed synthetic data: two hex tags per row, each tag value repeats
+-- every 997 or 1009 rows
+set client_min_messages to 'error';
+drop table if exists buf_tags;
+create table buf_tags(id bigserial, val text[]);
+set client_min_messages to 'warning';
+insert into buf_tags(val) select array[substr(md5((i % 997)::text), 1, 6), substr(md5('x' || (i % 1009)::text), 1, 6)] from generate_series(1, 10000) i;
+create index buf_tags_idx on buf_tags using gin (val parray_gin_ops);
+analyze buf_tags;
+set enable_seqscan to off;
+
+-- Buffers of the bitmap heap and index scan nodes, hits and reads
+-- together, and rows removed by recheck (null before 9.2, which does
+-- not report them). Buffer counts of a node include its children, so
+-- the index scan is subtracted from the heap scan.
+create function pg_temp.buf_explain(query text, out heap_buffers int, out index_buffers int, out removed int)
+language plpgsql as $$
+declare
+	line text;
+	node text := '';
+	opts text := 'analyze, buffers, costs off';
+	total int;
+begin
+	heap_buffers := 0;
+	index_buffers := 0;
+	removed := 0;
+	if current_setting('server_version_num')::int >= 90200 then
+		opts := opts || ', timing off';
+	else
+		removed := null;
+	end if;
+	for line in execute 'explain (' || opts || ') ' || query loop
+		if line like '%Bitmap Heap Scan%' then
+			node := 'heap';
+		elsif line like '%Bitmap Index Scan%' then
+			node := 'index';
+		elsif line like '%Rows Removed by Index Recheck:%' then
+			removed := substring(line from 'Recheck: ([0-9.]+)')::numeric::int;
+		elsif line like '%Buffers: shared%' then
+			total := coalesce(substring(line from 'hit=([0-9]+)')::int, 0)
+				+ coalesce(substring(line from 'read=([0-9]+)')::int, 0);
+			if node = 'heap' then
+				heap_buffers := total;
+			elsif node = 'index' then
+				index_buffers := total;
+			end if;
+			node := '';
+		end if;
+	end loop;
+	heap_buffers := heap_buffers - index_buffers;
+end
+$$;
+
+-- Bounds: a heap page per candidate row at most, a few entry and
+-- posting tree pages per key plus the metapage, a full scan reads each
+-- page about once. Recheck counts are exact for this data.
+
+-- 11
+select count(*) from buf_tags where val @> array['70efdf'];
+-- t
+select heap_buffers between 1 and 11 and index_buffers between 1 and 7 * 8 + 4 and coalesce(removed, 0) = 0 from pg_temp.buf_explain($q$select id from buf_tags where val @> array['70efdf']$q$);
+-- 11
+select count(*) from buf_tags where val @@> array['70e%'];
+-- t
+select heap_buffers between 1 and 11 and index_buffers between 1 and 3 * 8 + 4 and coalesce(removed, 0) = 0 from pg_temp.buf_explain($q$select id from buf_tags where val @@> array['70e%']$q$);
+-- 41
+select count(*) from buf_tags where val @@> array['%0ef%'];
+-- t
+select heap_buffers between 1 and 41 and index_buffers between 1 and 1 * 8 + 4 and coalesce(removed, 0) = 0 from pg_temp.buf_explain($q$select id from buf_tags where val @@> array['%0ef%']$q$);
+-- trigrams of different items, no match
+-- 0
+select count(*) from buf_tags where val @@> array['%a7c6%'];
+-- t
+select heap_buffers between 1 and 2 and index_buffers between 1 and 2 * 8 + 4 and coalesce(removed, 2) = 2 from pg_temp.buf_explain($q$select id from buf_tags where val @@> array['%a7c6%']$q$);
+-- 10
+select count(*) from buf_tags where val @@> array['%c3cb%'];
+-- t
+select heap_buffers between 1 and 12 and index_buffers between 1 and 2 * 8 + 4 and coalesce(removed, 2) = 2 from pg_temp.buf_explain($q$select id from buf_tags where val @@> array['%c3cb%']$q$);
+-- no trigrams, full index scan
+-- 451
+select count(*) from buf_tags where val @@> array['%0e%'];
+-- t
+select heap_buffers <= pg_relation_size('buf_tags') / current_setting('block_size')::int and index_buffers <= pg_relation_size('buf_tags_idx') / current_setting('block_size')::int + 8 and coalesce(removed, 9549) = 9549 from pg_temp.buf_explain($q$select id from buf_tags where val @@> array['%0e%']$q$);
+
+set enable_seqscan to on;
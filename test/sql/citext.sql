@@ -0,0 +1,65 @@
+set client_min_messages to 'error';
+drop extension if exists "parray_gin" cascade;
+create extension "parray_gin";
+set client_min_messages to 'warning';
+
+\t on
+\pset format unaligned
+
+set enable_seqscan to off;
+
+-- citext[] items are matched case-insensitively, checked if citext is available
+do $$
+declare
+	r bool;
+	n int;
+	line text;
+	indexed bool := false;
+begin
+	if not exists (select 1 from pg_available_extensions where name = 'citext') then
+		return;
+	end if;
+	create extension if not exists "citext";
+	create extension "parray_gin_citext";
+	execute $q$select array['Foo', 'BAR']::citext[] @> array['foo', 'bar']$q$ into r;
+	if not r then
+		raise exception 'citext @> failed';
+	end if;
+	execute $q$select array['Foo', 'BAR']::citext[] <@@ array['f%', 'Ba_']$q$ into r;
+	if not r then
+		raise exception 'citext <@@ failed';
+	end if;
+	execute $q$select array['Foo']::citext[] @@> array['%x%']$q$ into r;
+	if r then
+		raise exception 'citext @@> failed';
+	end if;
+	create table test_citext (val citext[]);
+	insert into test_citext select array['Foo' || i, 'BAR' || (i % 10)]::citext[] from generate_series(1, 100) i;
+	create index test_citext_idx on test_citext using gin (val parray_gin_citext_ops);
+	execute $q$select count(*) from test_citext where val @@> array['foo1%']$q$ into n;
+	if n <> 12 then
+		raise exception '@@> gave % rows', n;
+	end if;
+	execute $q$select count(*) from test_citext where val @> array['bar3']$q$ into n;
+	if n <> 10 then
+		raise exception '@> gave % rows', n;
+	end if;
+	execute $q$select count(*) from test_citext where val <@@ array['FOO5%', 'b%']$q$ into n;
+	if n <> 11 then
+		raise exception '<@@ gave % rows', n;
+	end if;
+	for line in execute $q$explain (costs off) select count(*) from test_citext where val @@> array['foo1%']$q$ loop
+		indexed := indexed or line like '%test_citext_idx%';
+	end loop;
+	if not indexed then
+		raise exception 'citext operator class is not used by the index';
+	end if;
+	drop table test_citext;
+	drop extension "parray_gin_citext";
+end
+$$;
+
+set enable_seqscan to on;
+
+\t off
+\pset format aligned
@@ -78,6 +78,394 @@ select count(*) from test_table where val <@@ array['foo4', 'baz%', 'bar4%e'];
 -- 0
 select count(*) from test_table where val <@@ array['qux'];
 
+-- short keys for patterns without trigrams
+drop index if exists test_val_idx;
+do $$
+begin
+	if current_setting('server_version_num')::int >= 130000 then
+		execute 'create index test_val_idx on test_table using gin (val parray_gin_ops(short_keys = true))';
+	else
+		execute 'create index test_val_idx on test_table using gin (val parray_gin_ops)';
+	end if;
+end
+$$;
+
+-- 2
+select count(*) from test_table where val @@> array['%4t%'];
+-- 2
+select count(*) from test_table where val @@> array['%u%'];
+-- 32
+select count(*) from test_table where val @@> array['%z%'];
+-- 10
+select count(*) from test_table where val @@> array['b%', '%4t%', 'f%'] or val @@> array['%1'];
+-- 8
+select count(*) from test_table where val @@> array['bar4%'];
+-- 3
+select count(*) from test_table where val @> array['bar4'];
+-- 32
+select count(*) from test_table where val <@@ array['%', 'qux'];
+-- 2
+select count(*) from test_table where val <@@ array['foo4', 'baz%', 'bar4%e'];
+
+-- lossless wide keys
+drop index if exists test_val_idx;
+create index test_val_idx on test_table using gin (val parray_gin_wide_ops);
+-- 8
+select count(*) from test_table where val @> array['foo1','bar1','baz1'];
+-- 8
+select count(*) from test_table where val @@> array['bar4%'];
+-- 4
+select count(*) from test_table where val @@> array['%bar4%o%'];
+-- 0
+select count(*) from test_table where val @@> array['qux%'];
+-- 2
+select count(*) from test_table where val <@@ array['foo4', 'baz%', 'bar4%e'];
+
+-- huge arrays are extracted item by item in bounded memory
+set client_min_messages to 'error';
+drop table if exists test_huge;
+create table test_huge(id bigserial, val text[]);
+set client_min_messages to 'warning';
+insert into test_huge(val) select array_agg('item' || i) from generate_series(1, 100000) i;
+insert into test_huge(val) values(array['item1', 'item2']);
+create index test_huge_idx on test_huge using gin (val parray_gin_ops);
+-- 1
+select count(*) from test_huge where val @@> array['item99999'];
+-- 2
+select count(*) from test_huge where val @> array['item2'];
+-- 1
+select count(*) from test_huge where val <@@ array['item_'];
+drop table test_huge;
+
+-- long items are cut by max_element_bytes but still found
+insert into test_table(val) values(array['foo5', repeat('payload ', 20) || 'needle']);
+drop index if exists test_val_idx;
+do $$
+begin
+	if current_setting('server_version_num')::int >= 130000 then
+		execute 'create index test_val_idx on test_table using gin (val parray_gin_ops(max_element_bytes = 64))';
+	else
+		execute 'create index test_val_idx on test_table using gin (val parray_gin_ops)';
+	end if;
+end
+$$;
+-- 1
+select count(*) from test_table where val @@> array['%needle'];
+-- 1
+select count(*) from test_table where val @@> array['foo5', '%payload%'];
+-- 0
+select count(*) from test_table where val @@> array['%haystack%'];
+-- 1
+select count(*) from test_table where val <@@ array['foo%', '%needle'];
+-- 8
+select count(*) from test_table where val @@> array['bar4%'];
+delete from test_table where val @> array['foo5'];
+
+-- repeated items hit the element cache
+set parray_gin.element_cache_size = 1000;
+drop index if exists test_val_idx;
+create index test_val_idx on test_table using gin (val parray_gin_ops);
+-- t
+select hits > misses and entries > 0 from parray_gin_element_cache_stats();
+-- 8
+select count(*) from test_table where val @> array['foo1','bar1','baz1'];
+-- 8
+select count(*) from test_table where val @@> array['bar4%'];
+-- 2
+select count(*) from test_table where val <@@ array['foo4', 'baz%', 'bar4%e'];
+reset parray_gin.element_cache_size;
+
+-- repeated arrays are rechecked once with the memo
+set parray_gin.recheck_memo_size = 16;
+-- t
+select parray_gin_stat_reset() >= now();
+-- 8
+select count(*) from test_table where val @> array['foo1','bar1','baz1'];
+-- 8|7
+select recheck_calls, recheck_memo_hits from parray_gin_stats;
+-- 8
+select count(*) from test_table where val @@> array['bar4%'];
+-- 4
+select count(*) from test_table where val @@> array['%bar4%o%'];
+-- 2
+select count(*) from test_table where val <@@ array['foo4', 'baz%', 'bar4%e'];
+reset parray_gin.recheck_memo_size;
+-- t
+select parray_gin_stat_reset() >= now();
+-- 8
+select count(*) from test_table where val @> array['foo1','bar1','baz1'];
+-- 8|0
+select recheck_calls, recheck_memo_hits from parray_gin_stats;
+
+-- like matching is skipped for items missing trigrams of a pattern
+set parray_gin.recheck_prefilter = on;
+-- 8
+select count(*) from test_table where val @@> array['bar4%'];
+-- t
+select parray_gin_stat_reset() >= now();
+-- 4
+select count(*) from test_table where val @@> array['%bar4%o%'];
+-- 8|4|12
+select recheck_calls, recheck_matches, recheck_prefilter_skips from parray_gin_stats;
+-- trigrams of the pattern are in different items, no like matching at all
+insert into test_table(val) values (array['abc1', 'xyz9']);
+-- t
+select parray_gin_stat_reset() >= now();
+-- 0
+select count(*) from test_table where val @@> array['%abc%xyz%'];
+-- 1|0|2
+select recheck_calls, recheck_matches, recheck_prefilter_skips from parray_gin_stats;
+delete from test_table where val @> array['abc1'];
+-- 2
+select count(*) from test_table where val <@@ array['foo4', 'baz%', 'bar4%e'];
+reset parray_gin.recheck_prefilter;
+
+-- runtime statistics of extraction, consistent and recheck
+-- t
+select parray_gin_stat_reset() >= now();
+insert into test_table(val) values (array['stat1', 'stat2']);
+-- 1
+select count(*) from test_table where val @> array['stat1'];
+-- 1|1|6|0|t
+select values_extracted, queries, query_keys, full_scans, candidates >= 1 and consistent_calls >= candidates and recheck_matches >= 1 from parray_gin_stats;
+-- planning alone is not counted
+do $$
+begin
+	execute $q$explain select count(*) from test_table where val @> array['stat2']$q$;
+end
+$$;
+-- 1|6|0
+select queries, query_keys, full_scans from parray_gin_stats;
+-- t
+select count(*) > 1 from test_table where val @@> array['%'];
+-- 2|6|1
+select queries, query_keys, full_scans from parray_gin_stats;
+delete from test_table where val @> array['stat1'];
+
+-- tracing, notices of an indexed value are shown
+set parray_gin.trace = notice;
+set client_min_messages to notice;
+insert into test_table(val) values (array['trace1']);
+set client_min_messages to 'warning';
+delete from test_table where val @> array['trace1'];
+-- notices of queries depend on the plan and are not shown
+-- 8
+select count(*) from test_table where val @@> array['bar4%'];
+-- 2
+select count(*) from test_table where val <@@ array['foo4', 'baz%', 'bar4%e'];
+-- sampling, none of the values is traced at rate 0 and each at rate 1
+set client_min_messages to notice;
+set parray_gin.trace_sample_rate = 0;
+insert into test_table(val) values (array['trace2']);
+set parray_gin.trace_sample_rate = 1;
+insert into test_table(val) values (array['trace3']);
+set client_min_messages to 'warning';
+delete from test_table where val @@> array['trace_'];
+reset parray_gin.trace_sample_rate;
+reset parray_gin.trace;
+
+-- heaviest keys of the index, checked since 9.4
+do $$
+declare
+	n int;
+	sorted bool;
+begin
+	if current_setting('server_version_num')::int < 90400 then
+		return;
+	end if;
+	select count(*), bool_and(postings >= coalesce(next, 0) and postings > 0)
+		into n, sorted
+		from (select postings, lead(postings) over (order by postings desc, key) as next
+			from parray_gin_index_keys('test_val_idx', 5)) s;
+	if n <> 5 or not sorted then
+		raise exception 'parray_gin_index_keys gave % keys, sorted %', n, sorted;
+	end if;
+	select count(*) into n from parray_gin_index_keys('test_val_idx', 0)
+		where kind <> 'trigram';
+	if n <> 0 then
+		raise exception 'parray_gin_index_keys gave % short keys', n;
+	end if;
+end
+$$;
+
+-- operators are parallel safe, checked since 10
+do $$
+declare
+	line text;
+	gathered bool := false;
+	n int;
+begin
+	if current_setting('server_version_num')::int < 100000 then
+		return;
+	end if;
+	perform set_config('enable_seqscan', 'on', true);
+	perform set_config('enable_bitmapscan', 'off', true);
+	perform set_config('parallel_setup_cost', '0', true);
+	perform set_config('parallel_tuple_cost', '0', true);
+	perform set_config('min_parallel_table_scan_size', '0', true);
+	perform set_config('max_parallel_workers_per_gather', '2', true);
+	for line in execute $q$explain (costs off) select count(*) from test_table where val @@> array['bar4%']$q$ loop
+		gathered := gathered or line like '%Gather%';
+	end loop;
+	if not gathered then
+		raise exception 'no parallel plan for @@>';
+	end if;
+	execute $q$select count(*) from test_table where val @@> array['bar4%']$q$ into n;
+	if n <> 8 then
+		raise exception 'parallel @@> gave % rows', n;
+	end if;
+end
+$$;
+
+-- operator functions are index conditions too, since 12
+-- 8
+select count(*) from test_table where parray_contains_partial(val, array['bar4%']);
+-- 2
+select count(*) from test_table where parray_contained_partial(val, array['foo4', 'baz%', 'bar4%e']);
+do $$
+declare
+	line text;
+	indexed bool := false;
+begin
+	if current_setting('server_version_num')::int < 120000 then
+		return;
+	end if;
+	for line in execute $q$explain (costs off) select count(*) from test_table where parray_contains_partial(val, array['bar4%'])$q$ loop
+		indexed := indexed or line like '%Index Cond%';
+	end loop;
+	if not indexed then
+		raise exception 'function call is not an index condition';
+	end if;
+end
+$$;
+
+-- varchar[] and name[] columns
+set client_min_messages to 'error';
+drop table if exists test_varchar;
+create table test_varchar(id bigserial, val varchar[], nval name[]);
+set client_min_messages to 'warning';
+insert into test_varchar(val, nval) select val, val from test_table;
+create index test_varchar_idx on test_varchar using gin (val parray_gin_varchar_ops);
+create index test_varchar_nidx on test_varchar using gin (nval parray_gin_name_ops);
+-- 8
+select count(*) from test_varchar where val @> array['foo1','bar1','baz1'];
+-- 8
+select count(*) from test_varchar where val @@> array['bar4%'];
+-- 2
+select count(*) from test_varchar where val <@@ array['foo4', 'baz%', 'bar4%e'];
+-- 8
+select count(*) from test_varchar where nval @@> array['bar4%'];
+-- 2
+select count(*) from test_varchar where nval <@@ array['foo4', 'baz%', 'bar4%e'];
+drop table test_varchar;
+
+-- jsonb arrays, checked since 9.4
+do $$
+declare
+	n int;
+begin
+	if current_setting('server_version_num')::int < 90400 then
+		return;
+	end if;
+	drop table if exists test_jsonb;
+	create table test_jsonb(id bigserial, doc jsonb);
+	insert into test_jsonb(doc) select array_to_json(val)::jsonb from test_table;
+	insert into test_jsonb(doc) values('{"tags": ["bar4"]}'), ('["bar4", 5]');
+	create index test_jsonb_idx on test_jsonb using gin (doc parray_gin_jsonb_ops);
+	execute $q$select count(*) from test_jsonb where doc @@> array['bar4%']$q$ into n;
+	if n <> 9 then
+		raise exception 'jsonb @@> gave % rows', n;
+	end if;
+	execute $q$select count(*) from test_jsonb where doc <@@ array['foo4', 'baz%', 'bar4%e']$q$ into n;
+	if n <> 2 then
+		raise exception 'jsonb <@@ gave % rows', n;
+	end if;
+	drop table test_jsonb;
+end
+$$;
+
+-- word operator class, items of two words
+set client_min_messages to 'error';
+drop table if exists test_words;
+create table test_words(id bigserial, val text[]);
+set client_min_messages to 'warning';
+insert into test_words(val) select array[val[1] || ' ' || val[2], val[3]] from test_table;
+create index test_words_idx on test_words using gin (val parray_gin_word_ops);
+-- 3
+select count(*) from test_words where val ~@> array['bar4'];
+-- 8
+select count(*) from test_words where val ~@> array['BAR1 foo1'];
+-- 8
+select count(*) from test_words where val ~@> array['foo4'];
+-- 0
+select count(*) from test_words where val ~@> array['foo1 baz1'];
+-- 32
+select count(*) from test_words where val ~@> array[]::text[];
+do $$
+declare
+	line text;
+	indexed bool := false;
+begin
+	for line in execute $q$explain (costs off) select count(*) from test_words where val ~@> array['bar4']$q$ loop
+		indexed := indexed or line like '%test_words_idx%';
+	end loop;
+	if not indexed then
+		raise exception 'word operator does not use the index';
+	end if;
+end
+$$;
+drop table test_words;
+
+-- accent-insensitive operators with and without option unaccent,
+-- checked since 13 in UTF8
+do $$
+declare
+	n int;
+	line text;
+	indexed bool := false;
+begin
+	if current_setting('server_version_num')::int < 130000 or
+		current_setting('server_encoding') <> 'UTF8' then
+		return;
+	end if;
+	drop table if exists test_accents;
+	create table test_accents(id bigserial, val text[]);
+	insert into test_accents(val) select val from test_table;
+	insert into test_accents(val) values(array[U&'caf\00E9', 'bar4']),
+		(array[U&'Caf\00E9 cr\00E8me']), (array['cafe']);
+	create index test_accents_idx on test_accents using gin (val parray_gin_ops);
+	execute $q$select count(*) from test_accents where val @@~> array['caf%']$q$ into n;
+	if n <> 2 then
+		raise exception '@@~> without unaccent gave % rows', n;
+	end if;
+	drop index test_accents_idx;
+	create index test_accents_idx on test_accents using gin (val parray_gin_ops(unaccent = true));
+	execute $q$select count(*) from test_accents where val @@~> array['caf%']$q$ into n;
+	if n <> 2 then
+		raise exception '@@~> gave % rows', n;
+	end if;
+	execute $q$select count(*) from test_accents where val @@~> array['%creme%']$q$ into n;
+	if n <> 1 then
+		raise exception '@@~> gave % rows for infix', n;
+	end if;
+	execute $q$select count(*) from test_accents where val @@> array[U&'caf\00E9']$q$ into n;
+	if n <> 1 then
+		raise exception '@@> gave % rows', n;
+	end if;
+	execute $q$select count(*) from test_accents where val <~@@ array['cafe', 'bar%']$q$ into n;
+	if n <> 2 then
+		raise exception '<~@@ gave % rows', n;
+	end if;
+	for line in execute $q$explain (costs off) select count(*) from test_accents where val @@~> array['%creme%']$q$ loop
+		indexed := indexed or line like '%test_accents_idx%';
+	end loop;
+	if not indexed then
+		raise exception 'accent-insensitive operator does not use the index';
+	end if;
+	drop table test_accents;
+end
+$$;
+
 set enable_seqscan to on;
 
 \t off
@@ -72,5 +72,228 @@ select array['foo'] <@@ array['f%', 'c%'];
 -- f
 select array['cow'] <@@ array['f%'];
 
+-- like matching skipped for items missing trigrams of a pattern
+set parray_gin.recheck_prefilter = on;
+-- t
+select (array['food', 'booze', 'baz']) @@> array['%ooz%', 'ba%'];
+-- f
+select (array['foo', 'boo', 'baz']) @@> array['%ooz%'];
+-- t
+select (array['Foo', 'boo']) @@> array['%o%', 'Fo_'];
+-- f
+select (array['FOO']) @@> array['fo%'];
+-- t
+select array['foo', 'cow'] <@@ array['cow', 'f%', '%ba%'];
+-- f
+select array['foo', 'cow'] <@@ array['qux%', 'f%'];
+reset parray_gin.recheck_prefilter;
+
+-- 8|8|0
+select * from parray_gin_collisions(array['foo', 'bar']);
+-- 4|4|0
+select * from parray_gin_collisions(array['foo', 'foo', null]);
+
+-- multibyte trigrams give the keys of the index, checked in UTF8: one
+-- key each before 11, bytewise keys since
+do $$
+declare
+	r record;
+	bytewise bool := current_setting('server_version_num')::int >= 110000;
+begin
+	if current_setting('server_encoding') <> 'UTF8' then
+		return;
+	end if;
+	select * into r from parray_gin_collisions(array[U&'\0451\043B\043A\0430']);
+	if r.trigrams <> 5 or r.keys <> (case when bytewise then 9 else 5 end) or
+		r.collision_rate <> (case when bytewise then 0.6 else 0 end) then
+		raise exception 'multibyte collisions: %', r;
+	end if;
+end
+$$;
+
+-- keys of items and patterns
+-- 1[  a],1[ ab],1[ab ],2[  x],2[ x ]
+select string_agg(item || '[' || trigram || ']', ',' order by item, key) from parray_gin_keys(array['ab', 'x']);
+-- trigram|foo
+select kind, trigram from parray_gin_keys(array['%foo%'], true);
+-- 0
+select count(*) from parray_gin_keys(array['%oo%'], true);
+-- bigram|oo
+select kind, trigram from parray_gin_keys(array['%oo%'], true, true);
+
+-- varchar[] and name[] items are matched to text[] patterns
+-- t
+select array['Foo', 'bar']::varchar[] @@> array['Fo%'];
+-- f
+select array['Foo', 'bar']::varchar[] @@> array['fo%'];
+-- t
+select array['Foo', 'bar']::varchar[] @> array['bar'];
+-- t
+select array['foo', 'bar']::name[] @> array['bar'];
+-- t
+select array['foo', 'bar']::name[] <@@ array['f%', 'b%'];
+-- f
+select array['foo', 'bar']::name[] <@ array['foo'];
+
+-- string items of jsonb arrays, checked since 9.4
+do $$
+declare
+	r bool;
+begin
+	if current_setting('server_version_num')::int < 90400 then
+		return;
+	end if;
+	execute $q$select '["foo", "bar", 1, {"baz": "qux"}]'::jsonb @@> array['fo%', 'bar']$q$ into r;
+	if not r then
+		raise exception 'jsonb @@> failed';
+	end if;
+	execute $q$select '["foo", "bar"]'::jsonb @@> array['baz%']$q$ into r;
+	if r then
+		raise exception 'jsonb @@> matched missing item';
+	end if;
+	execute $q$select '["foo", "bar"]'::jsonb <@@ array['f%', '%a%']$q$ into r;
+	if not r then
+		raise exception 'jsonb <@@ failed';
+	end if;
+	execute $q$select '["foo", 1]'::jsonb <@@ array['f%']$q$ into r;
+	if r then
+		raise exception 'jsonb <@@ matched non-string item';
+	end if;
+	execute $q$select '"foo"'::jsonb <@@ array['f%']$q$ into r;
+	if r then
+		raise exception 'jsonb <@@ matched scalar';
+	end if;
+	execute $q$select '{"a": "foo"}'::jsonb <@@ array['%']$q$ into r;
+	if r then
+		raise exception 'jsonb <@@ matched object';
+	end if;
+	execute $q$select '{"a": "foo"}'::jsonb @@> array[]::text[]$q$ into r;
+	if r then
+		raise exception 'jsonb @@> matched object';
+	end if;
+end
+$$;
+
+-- arrays built by PL/pgSQL are expanded since 9.5, with and without memo
+do $$
+declare
+	tags text[] := '{}';
+	memo text;
+begin
+	for i in 1..20 loop
+		tags := tags || ('tag' || i);
+	end loop;
+	tags[25] := 'late';
+	foreach memo in array array['0', '16'] loop
+		perform set_config('parray_gin.recheck_memo_size', memo, true);
+		if not tags @@> array['tag1_', 'lat%'] then
+			raise exception 'expanded @@> failed';
+		end if;
+		if tags @@> array['tag3_'] then
+			raise exception 'expanded @@> matched missing item';
+		end if;
+		if not tags @> array['tag7', 'late'] then
+			raise exception 'expanded @> failed';
+		end if;
+		if tags <@@ array['tag%', 'late'] then
+			raise exception 'expanded <@@ matched null item';
+		end if;
+		if not tags[1:20] <@@ array['tag%'] then
+			raise exception 'expanded <@@ failed';
+		end if;
+	end loop;
+end
+$$;
+
+-- words, some item must have all of them
+-- t
+select (array['payment failed, retry', 'ok']) ~@> array['Retry payment'];
+-- t
+select (array['payment failed', 'ok']) ~@> array['failed', 'PAYMENT'];
+-- f
+select (array['payment failed', 'retry']) ~@> array['payment retry'];
+-- f
+select (array['payments failed']) ~@> array['payment'];
+-- t
+select (array['payment failed']) ~@> array['%', '']::text[];
+-- f
+select (array[null, 'ok']::text[]) ~@> array['failed'];
+
+-- accent-insensitive partial operators, checked since 13 in UTF8
+do $$
+begin
+	if current_setting('server_version_num')::int < 130000 or
+		current_setting('server_encoding') <> 'UTF8' then
+		return;
+	end if;
+	if not array[U&'caf\00E9', U&'na\00EFve'] @@~> array['cafe%', 'naive'] then
+		raise exception '@@~> failed';
+	end if;
+	if array[U&'caf\00E9'] @@> array['cafe%'] then
+		raise exception '@@> matched without diacritics';
+	end if;
+	if not array['cafe'] @@~> array[U&'caf\00E9'] then
+		raise exception '@@~> failed for accented pattern';
+	end if;
+	if array[U&'cr\00E8me'] @@~> array['cream%'] then
+		raise exception '@@~> matched missing item';
+	end if;
+	if not array[U&'cr\00E8me br\00FBl\00E9e'] <~@@ array['%creme%'] then
+		raise exception '<~@@ failed';
+	end if;
+	if not array[U&'\FB01ne'] @@~> array['fine'] then
+		raise exception '@@~> failed for compatibility decomposition';
+	end if;
+end
+$$;
+
+-- precomputed trigrams of items
+-- {[202061 206162 616263 626320],[]}
+select parray_trgm(array['abc', null]);
+-- {}
+select parray_trgm(array[]::text[]);
+-- {[202061 206162],[]}
+select '{ [206162 202061 202061], [] }'::parray_trgm;
+-- t
+select parray_trgm(array['foo bar', 'baz']) %@@> array['%bar%'];
+-- f
+select parray_trgm(array['foo bar', 'baz']) %@@> array['%qux%'];
+-- t
+select parray_trgm(array['foo bar', 'baz']) %@@> array['%x%'];
+-- f
+select parray_trgm(array['foo bar', 'baz']) %@@> array['%bar%', '%qux%'];
+-- t
+select parray_trgm(array['foo bar', 'baz']) %@@> array['fo%', 'baz'];
+-- f
+select parray_trgm(array['foo', 'bar']) %@@> array['%foo%bar%'];
+-- 0.57
+select round(parray_trgm_similarity(parray_trgm(array['abc', 'words']), 'word')::numeric, 2);
+-- 0
+select parray_trgm_similarity(parray_trgm(array[null]::text[]), 'word');
+-- 0
+select parray_trgm(array['abc', 'word']) <-> 'word';
+
+-- generated column of trigrams, checked since 12
+do $$
+declare
+	n int;
+begin
+	if current_setting('server_version_num')::int < 120000 then
+		return;
+	end if;
+	execute 'create temp table test_trgm(val text[], trgm parray_trgm generated always as (parray_trgm(val)) stored)';
+	insert into test_trgm(val) values(array['payment failed', 'retry']), (array['ok']), (array['failed']);
+	execute $q$select count(*) from test_trgm where trgm %@@> array['%fail%'] and val @@> array['%fail%']$q$ into n;
+	if n <> 2 then
+		raise exception 'prefilter gave % rows', n;
+	end if;
+	execute $q$select count(*) from test_trgm where trgm <-> 'payment failes' < 0.5$q$ into n;
+	if n <> 1 then
+		raise exception 'distance gave % rows', n;
+	end if;
+	drop table test_trgm;
+end
+$$;
+
 \t off
 \pset format aligned